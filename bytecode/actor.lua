@@ -30,6 +30,26 @@ f:write(chan_op_bytecode)
 f:close()
 chan_op_cdef = strip_xxd_hdr(io.popen('xxd -i ' .. OUTPUT))
 
+function receive_many_bootstrap(error, drain, receive)
+    return function(inbox, max)
+        local e, msgs = drain(inbox, max)
+        if e then
+            error(e, 0)
+        end
+        if #msgs == 0 and max > 0 then
+            msgs[1] = receive(inbox)
+            drain(inbox, max - 1, msgs)
+        end
+        return msgs
+    end
+end
+
+receive_many_bytecode = string.dump(receive_many_bootstrap, true)
+f = io.open(OUTPUT, 'wb')
+f:write(receive_many_bytecode)
+f:close()
+receive_many_cdef = strip_xxd_hdr(io.popen('xxd -i ' .. OUTPUT))
+
 f = io.open(OUTPUT, 'wb')
 
 f:write([[
@@ -45,4 +65,14 @@ f:write('};')
 f:write(string.format('std::size_t chan_op_bytecode_size = %i;',
                       #chan_op_bytecode))
 
+f:write([[
+unsigned char receive_many_bytecode[] = {
+]])
+
+f:write(receive_many_cdef)
+
+f:write('};')
+f:write(string.format('std::size_t receive_many_bytecode_size = %i;',
+                      #receive_many_bytecode))
+
 f:write('} // namespace emilua')
@@ -14,15 +14,14 @@ end
 function spawn_start_fn_bootstrap(root_scope, set_current_traceback,
                                   terminate_vm_with_cleanup_error, xpcall,
                                   pcall, error, unpack)
+    local function on_error(e)
+        set_current_traceback()
+        return e
+    end
+
     return function(start_fn)
         return function()
-            local ret = {xpcall(
-                start_fn,
-                function(e)
-                    set_current_traceback()
-                    return e
-                end
-            )}
+            local ret = {xpcall(start_fn, on_error)}
             do
                 local cleanup_handlers = root_scope()
                 local i = #cleanup_handlers
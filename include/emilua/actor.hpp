@@ -18,6 +18,9 @@ extern char inbox_key;
 
 void init_actor_module(lua_State* L);
 
+// Must run on the strand of `vm_ctx`
+void deliver_queued_message(vm_context& vm_ctx);
+
 #if EMILUA_CONFIG_ENABLE_LINUX_NAMESPACES
 extern char linux_container_chan_mt_key;
 
@@ -42,6 +45,7 @@ struct linux_container_reaper : public pending_operation
 
     int childpidfd;
     pid_t childpid;
+    bool from_zygote = false;
 };
 
 struct linux_container_address
@@ -52,6 +56,10 @@ struct linux_container_address
 
     asio::local::datagram_protocol::socket dest;
     linux_container_reaper* reaper = nullptr;
+
+    // Only the channels returned by spawn_vm() may carry strings longer than
+    // 255 bytes (see linux_container_inbox_service::accept_large_strings)
+    bool large_strings = false;
 };
 #endif // EMILUA_CONFIG_ENABLE_LINUX_NAMESPACES
 
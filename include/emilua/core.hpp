@@ -6,13 +6,17 @@
 #pragma once
 
 #include <boost/asio/bind_cancellation_slot.hpp>
+#include <boost/asio/associated_allocator.hpp>
 #include <boost/asio/cancellation_signal.hpp>
 #include <boost/asio/executor_work_guard.hpp>
 #include <boost/asio/io_context_strand.hpp>
 #include <boost/asio/bind_executor.hpp>
 #include <boost/core/ignore_unused.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/intrusive/list.hpp>
+#include <boost/smart_ptr/intrusive_ref_counter.hpp>
+#include <boost/smart_ptr/intrusive_ptr.hpp>
 #include <boost/predef/os/linux.h>
 #include <boost/predef/os/unix.h>
 #include <boost/config.hpp>
@@ -38,11 +42,18 @@
 #include <condition_variable>
 #include <unordered_map>
 #include <system_error>
+#include <functional>
 #include <string_view>
 #include <filesystem>
+#include <algorithm>
 #include <optional>
+#include <cstdint>
 #include <variant>
 #include <atomic>
+#include <limits>
+#include <array>
+#include <chrono>
+#include <thread>
 #include <deque>
 #include <mutex>
 #include <map>
@@ -61,8 +72,8 @@ extern "C" {
 #include <boost/shared_ptr.hpp>
 #endif // EMILUA_CONFIG_ENABLE_PLUGINS
 
-#define EMILUA_IMPL_INITIAL_FIBER_DATA_CAPACITY 11
-#define EMILUA_IMPL_INITIAL_MODULE_FIBER_DATA_CAPACITY 8
+#define EMILUA_IMPL_INITIAL_FIBER_DATA_CAPACITY 7
+#define EMILUA_IMPL_INITIAL_MODULE_FIBER_DATA_CAPACITY 7
 
 // EMILUA_IMPL_INITIAL_MODULE_FIBER_DATA_CAPACITY currently takes into
 // consideration:
@@ -70,12 +81,14 @@ extern "C" {
 // * STACK
 // * LEAF
 // * CONTEXT
-// * INTERRUPTION_DISABLED
 // * JOINER
 // * STATUS
 // * SOURCE_PATH
 // * LOCAL_STORAGE
 
+// Max number of finished fibers each VM keeps around to be reused by spawn()
+#define EMILUA_IMPL_FIBER_POOL_CAPACITY 128
+
 #define EMILUA_CHECK_SUSPEND_ALLOWED(VM_CTX, L)             \
     if (!emilua::detail::unsafe_can_suspend((VM_CTX), (L))) \
         return lua_error((L));
@@ -119,16 +132,12 @@ enum FiberDataIndex: lua_Integer
     JOINER = 1,
     STATUS,
     SOURCE_PATH,
-    SUSPENSION_DISALLOWED,
     LOCAL_STORAGE,
     STACKTRACE,
 
-    // data used by the interruption system {{{
-    INTERRUPTION_DISABLED,
-    INTERRUPTED,
-    INTERRUPTER,
-    ASIO_CANCELLATION_SIGNAL,
-    DEFAULT_EMIT_SIGNAL_INTERRUPTER,
+    // data used by the interruption system (the rest lives in
+    // native_fiber_data) {{{
+    INTERRUPTER, //< only used for interrupters written in Lua
     USER_HANDLE, //< "augmented joiner"
     // }}}
 
@@ -210,6 +219,100 @@ struct TransparentStringHash : private std::hash<std::string_view>
     }
 };
 
+// Per-thread cache of the memory blocks used by the completion handlers of the
+// VMs' async operations. Blocks are kept in power-of-granularity size classes
+// so the next operation with a similar handler (which is the common case for a
+// fiber looping over read()/write()) reuses the block from the previous one
+// instead of going through the global allocator.
+//
+// Asio frees the operation block from whichever thread runs the completion, so
+// a block may move to the cache of another thread. Every thread only touches
+// its own cache and there's no synchronization. Unlike Asio's own per-thread
+// recycling (a couple of blocks), it keeps a block for each operation in
+// flight.
+class handler_memory_pool
+{
+public:
+    static constexpr std::size_t granularity = 64;
+    static constexpr std::size_t max_block_size = 1024;
+    static constexpr std::size_t max_cached_blocks = 64;
+
+    handler_memory_pool(const handler_memory_pool&) = delete;
+    handler_memory_pool& operator=(const handler_memory_pool&) = delete;
+
+    // Throws: std::bad_alloc
+    static void* allocate(std::size_t size);
+    static void deallocate(void* p, std::size_t size) noexcept;
+
+private:
+    handler_memory_pool() = default;
+    ~handler_memory_pool();
+
+    // Null once the calling thread's cache was destroyed (thread exit)
+    static handler_memory_pool* this_thread() noexcept;
+
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    struct free_list
+    {
+        free_block* head = nullptr;
+        std::size_t size = 0;
+    };
+
+    static std::size_t size_class(std::size_t size) noexcept
+    {
+        return (std::max<std::size_t>(size, 1) - 1) / granularity;
+    }
+
+    std::array<free_list, max_block_size / granularity> free_lists;
+};
+
+// Associated allocator for the handlers bound to
+// vm_context::strand_using_defer()
+template<class T>
+class recycling_handler_allocator
+{
+public:
+    using value_type = T;
+
+    recycling_handler_allocator() noexcept = default;
+
+    template<class U>
+    recycling_handler_allocator(const recycling_handler_allocator<U>&) noexcept
+    {}
+
+    T* allocate(std::size_t n)
+    {
+        if (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+            return std::allocator<T>{}.allocate(n);
+
+        return static_cast<T*>(handler_memory_pool::allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        if (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+            return std::allocator<T>{}.deallocate(p, n);
+
+        handler_memory_pool::deallocate(p, sizeof(T) * n);
+    }
+
+    template<class U>
+    bool operator==(const recycling_handler_allocator<U>&) const noexcept
+    {
+        return true;
+    }
+
+    template<class U>
+    bool operator!=(const recycling_handler_allocator<U>&) const noexcept
+    {
+        return false;
+    }
+};
+
 template<class Executor>
 class remap_post_to_defer: private Executor
 {
@@ -225,6 +328,14 @@ public:
         : Executor(std::move(ex))
     {}
 
+    // Handlers bound to this executor through asio::bind_executor() allocate
+    // from here (see the associated_allocator specialization at the end of
+    // this file).
+    recycling_handler_allocator<void> handler_allocator() const noexcept
+    {
+        return recycling_handler_allocator<void>{};
+    }
+
     bool operator==(const remap_post_to_defer& o) const noexcept
     {
         return static_cast<const Executor&>(*this) ==
@@ -272,6 +383,142 @@ public:
     }
 };
 
+// Scheduler counters for a single VM. They're written from the VM's strand
+// (`pending_handlers` also from whoever posts to it) and may be read from any
+// thread.
+struct vm_scheduler_stats
+{
+    struct snapshot_type
+    {
+        std::uint64_t resumes;
+        std::chrono::nanoseconds resume_time;
+        std::chrono::nanoseconds longest_slice;
+        std::size_t pending_handlers;
+        std::size_t inbox_backlog;
+    };
+
+    snapshot_type snapshot() const noexcept
+    {
+        return {
+            resumes.load(std::memory_order_relaxed),
+            std::chrono::nanoseconds{
+                resume_time_ns.load(std::memory_order_relaxed)},
+            std::chrono::nanoseconds{
+                longest_slice_ns.load(std::memory_order_relaxed)},
+            pending_handlers.load(std::memory_order_relaxed),
+            inbox_backlog.load(std::memory_order_relaxed)
+        };
+    }
+
+    // number of lua_resume() calls
+    std::atomic<std::uint64_t> resumes = 0;
+
+    // time spent inside lua_resume()
+    std::atomic<std::int64_t> resume_time_ns = 0;
+    std::atomic<std::int64_t> longest_slice_ns = 0;
+
+    // handlers queued through post()/defer() on the VM's strand that didn't
+    // run yet
+    std::atomic_size_t pending_handlers = 0;
+
+    // messages waiting in the VM's inbox
+    std::atomic_size_t inbox_backlog = 0;
+};
+
+// The VM's strand as returned by vm_context::strand(). Handlers queued through
+// post()/defer() are accounted in vm_scheduler_stats::pending_handlers.
+template<class Executor>
+class counting_executor: private Executor
+{
+public:
+    counting_executor(const counting_executor&) = default;
+    counting_executor(counting_executor&&) = default;
+
+    counting_executor(const Executor& ex,
+                      std::shared_ptr<vm_scheduler_stats> stats)
+        : Executor(ex)
+        , stats(std::move(stats))
+    {}
+
+    bool operator==(const counting_executor& o) const noexcept
+    {
+        return static_cast<const Executor&>(*this) ==
+            static_cast<const Executor&>(o);
+    }
+
+    bool operator!=(const counting_executor& o) const noexcept
+    {
+        return static_cast<const Executor&>(*this) !=
+            static_cast<const Executor&>(o);
+    }
+
+    const Executor& get_inner_executor() const noexcept
+    {
+        return *this;
+    }
+
+    decltype(std::declval<Executor>().context())
+    context() const noexcept
+    {
+        return Executor::context();
+    }
+
+    bool running_in_this_thread() const noexcept
+    {
+        return Executor::running_in_this_thread();
+    }
+
+    void on_work_started() const noexcept
+    {
+        Executor::on_work_started();
+    }
+
+    void on_work_finished() const noexcept
+    {
+        Executor::on_work_finished();
+    }
+
+    template<class F, class A>
+    void dispatch(F&& f, const A& a) const
+    {
+        Executor::dispatch(std::forward<F>(f), a);
+    }
+
+    template<class F, class A>
+    void post(F&& f, const A& a) const
+    {
+        ++stats->pending_handlers;
+        Executor::post(
+            counted_handler<std::decay_t<F>>{std::forward<F>(f), stats}, a);
+    }
+
+    template<class F, class A>
+    void defer(F&& f, const A& a) const
+    {
+        ++stats->pending_handlers;
+        Executor::defer(
+            counted_handler<std::decay_t<F>>{std::forward<F>(f), stats}, a);
+    }
+
+private:
+    // Handlers that are destroyed without running (i.e. the execution context
+    // is gone) are never subtracted, but then nobody is left to care.
+    template<class F>
+    struct counted_handler
+    {
+        void operator()()
+        {
+            --stats->pending_handlers;
+            f();
+        }
+
+        F f;
+        std::shared_ptr<vm_scheduler_stats> stats;
+    };
+
+    std::shared_ptr<vm_scheduler_stats> stats;
+};
+
 #if EMILUA_CONFIG_ENABLE_PLUGINS
 class BOOST_SYMBOL_VISIBLE plugin;
 #endif // EMILUA_CONFIG_ENABLE_PLUGINS
@@ -315,9 +562,57 @@ private:
     };
 
 public:
+    // Execution context owned by a single thread (thread-per-core mode)
+    struct core_context
+    {
+        explicit core_context(asio::io_context& ioctx)
+            : ioctx{ioctx}
+        {}
+
+        asio::io_context& ioctx;
+
+        // number of live VMs running on this core
+        std::atomic_size_t nvms = 0;
+    };
+
+    enum class placement_policy
+    {
+        round_robin,
+        least_loaded
+    };
+
+    enum class pool_refill_policy
+    {
+        // replace every VM taken from the pool right away
+        eager,
+        // refill the pool only once half of it has been used up
+        low_watermark
+    };
+
     app_context() = default;
     app_context(const app_context&) = delete;
 
+    // Returns the core where the next VM should be spawned. Only valid if
+    // `cores` isn't empty.
+    core_context& pick_core();
+
+    // Lets the cores finish once they run out of work. Called when `nvms`
+    // reaches 0, which may happen more than once (and from any thread), but
+    // only the first call touches `core_work_guards`.
+    void release_core_work_guards();
+
+    struct vm_stats_entry
+    {
+        std::weak_ptr<vm_context> vm;
+        vm_scheduler_stats::snapshot_type stats;
+    };
+
+    // Scheduler counters for every live VM in the process (in no particular
+    // order)
+    //
+    // Throws: std::bad_alloc
+    std::vector<vm_stats_entry> vm_stats();
+
     template<class Dom>
     void init_log_domain()
     {
@@ -345,8 +640,19 @@ public:
 
     std::vector<std::filesystem::path> emilua_path;
 
-    std::unordered_map<std::filesystem::path, std::string, path_hash>
-        modules_cache_registry;
+    // empty if the on-disk bytecode cache is disabled
+    std::filesystem::path bytecode_cache_dir;
+
+    struct module_cache_entry
+    {
+        std::filesystem::file_time_type mtime;
+        std::string bytecode;
+    };
+
+    std::unordered_map<
+        std::filesystem::path, std::shared_ptr<const module_cache_entry>,
+        path_hash
+    > modules_cache_registry;
     std::unordered_map<
         std::filesystem::path, std::unique_ptr<rdf_error_category>, path_hash
     > rdf_ec_cache_registry;
@@ -361,6 +667,85 @@ public:
     std::mutex extra_threads_count_mtx;
     std::condition_variable extra_threads_count_empty_cond;
 
+    // Thread-per-core mode (--cores). Empty if disabled. The first core is the
+    // main context. Every core (the main context included) is kept alive by
+    // `core_work_guards` until the last VM in the process is gone (see
+    // release_core_work_guards()).
+    std::deque<core_context> cores;
+    placement_policy core_placement_policy = placement_policy::round_robin;
+    std::atomic_size_t next_core = 0;
+    std::vector<asio::executor_work_guard<asio::io_context::executor_type>>
+        core_work_guards;
+    std::atomic_bool core_work_guards_released = false;
+    std::atomic_size_t nvms = 0;
+
+    // Pre-initialized VMs kept per io_context for spawn_vm() (see
+    // vm_pool_service). 0 disables the pool.
+    std::size_t vm_pool_size = 0;
+    pool_refill_policy vm_pool_refill_policy = pool_refill_policy::eager;
+
+    // every live VM (see vm_stats())
+    std::set<vm_context*> vms;
+    std::mutex vms_mtx;
+
+    // --profile. Null if disabled.
+    struct profiler_state
+    {
+        ~profiler_state();
+
+        // Spawns `sampler`. It ticks every millisecond no matter how often
+        // VMs are switched and each tick arms a one-shot hook in every VM
+        // being resumed (one per thread) which records the sample.
+        void start();
+        void stop();
+
+        // Samples recorded on one thread. Only the owning thread touches
+        // `pending` and `nlost`.
+        struct thread_slot
+        {
+            // VM being resumed on this thread. Guarded by `hook_mtx`.
+            vm_context* attached = nullptr;
+
+            // Folded stacks ('\n'-terminated) recorded by the hook. Reserved
+            // up front so the hook never allocates. Samples that don't fit
+            // are only counted in `nlost`.
+            std::string pending;
+            std::uint64_t nlost = 0;
+        };
+
+        // The calling thread's slot (registered on first use)
+        thread_slot& this_thread();
+
+        // Moves `slot.pending` into `samples`
+        void flush(thread_slot& slot);
+
+        // Guards the `attached` fields and the hooks armed by `sampler`
+        std::mutex hook_mtx;
+        std::vector<std::unique_ptr<thread_slot>> slots;
+
+        std::thread sampler;
+        std::atomic_bool stop_requested = false;
+
+        std::mutex samples_mtx;
+        // folded stack => number of samples
+        std::unordered_map<std::string, std::uint64_t> samples;
+    };
+    std::unique_ptr<profiler_state> profiler;
+
+    // --trace (see emilua/tracer.hpp). Null if disabled.
+    struct tracer_state
+    {
+        std::chrono::steady_clock::time_point epoch =
+            std::chrono::steady_clock::now();
+        std::atomic_uint64_t next_pid = 1;
+        std::atomic_uint64_t next_flow_id = 1;
+
+        std::mutex mtx;
+        // serialized JSON objects
+        std::vector<std::string> events;
+    };
+    std::unique_ptr<tracer_state> tracer;
+
 #if EMILUA_CONFIG_ENABLE_LINUX_NAMESPACES
     int linux_namespaces_service_sockfd = -1;
 #endif // EMILUA_CONFIG_ENABLE_LINUX_NAMESPACES
@@ -441,15 +826,65 @@ struct inbox_t
 
         std::shared_ptr<file_descriptor_box> inbox;
     };
+
+    // A linux_container_message::large_string. The read-only mapping of the
+    // sender's sealed memfd is kept until the string is pushed into the
+    // receiver's Lua state so the bytes are only copied once.
+    struct mapped_string
+    {
+        mapped_string(const char* data, std::size_t size)
+            : data{data}
+            , size{size}
+        {}
+
+        mapped_string(const mapped_string&) = delete;
+        mapped_string& operator=(const mapped_string&) = delete;
+
+        ~mapped_string();
+
+        const char* data;
+        std::size_t size;
+    };
 #endif // EMILUA_CONFIG_ENABLE_LINUX_NAMESPACES
 
+    // A byte_span taken from the sender. `data` is either the sender's own
+    // buffer (when nothing else referenced it) or a private copy.
+    struct byte_span_box
+    {
+        std::shared_ptr<unsigned char[]> data;
+        lua_Integer size;
+        lua_Integer capacity;
+    };
+
+    struct value_type;
+
+    // A table message encoded into a single contiguous buffer (see
+    // actor.ypp for the layout) so sending it doesn't allocate one node per
+    // key and per nested table. Leaves that own resources (addresses, file
+    // descriptors, byte spans) are kept out-of-line in `refs` and referenced
+    // by index from `buffer`.
+    struct flat_message
+    {
+        std::vector<unsigned char> buffer;
+        std::vector<value_type> refs;
+    };
+
+    // A payload serialized once by broadcast() and shared (read-only) by every
+    // receiver. Leaves that own resources are copied for each receiver.
+    struct shared_message
+    {
+        std::shared_ptr<const value_type> payload;
+    };
+
     struct value_type: std::variant<
-        bool, lua_Number, std::string,
+        bool, lua_Number, std::string, byte_span_box, flat_message,
+        shared_message,
 #if BOOST_OS_UNIX
         std::shared_ptr<file_descriptor_box>,
 #endif // BOOST_OS_UNIX
 #if EMILUA_CONFIG_ENABLE_LINUX_NAMESPACES
         linux_container_address,
+        std::shared_ptr<const mapped_string>,
 #endif // EMILUA_CONFIG_ENABLE_LINUX_NAMESPACES
         std::map<std::string, value_type>,
         std::vector<value_type>,
@@ -469,6 +904,42 @@ struct inbox_t
     using value_object_type = std::map<std::string, value_type>;
     using value_array_type = std::vector<value_type>;
 
+    // Shared by a rendezvous sender and its queued message. Whoever settles it
+    // first decides the outcome: the receiver (message received), the sender's
+    // interrupter (message withdrawn) or closing the inbox. This way the
+    // interrupter doesn't need to look for the message in the destination's
+    // queue.
+    struct send_ticket
+        : boost::intrusive_ref_counter<send_ticket, boost::thread_safe_counter>
+    {
+        bool settle() noexcept
+        {
+            return !settled.exchange(true);
+        }
+
+        // Sender's strand only, once the outcome is known. Hands back the
+        // values the send moved out of the sender's objects (e.g. byte_spans)
+        // if the message wasn't received or just releases them otherwise.
+        void settle_sender(lua_State* L, bool received)
+        {
+            auto f = std::move(on_sender_settled);
+            on_sender_settled = nullptr;
+            if (f)
+                f(L, received);
+        }
+
+        std::atomic_bool settled = false;
+
+        // Number of send_many() batch members taken by the receiver so far.
+        // Incremented before `settled` is checked so a sender that wins
+        // settle() never hands back values from a message being received (a
+        // member counted but then found withdrawn is dropped instead).
+        std::atomic_size_t nreceived = 0;
+
+        // See settle_sender()
+        std::function<void(lua_State*, bool)> on_sender_settled;
+    };
+
     struct sender_state
     {
         sender_state(vm_context& vm_ctx);
@@ -495,15 +966,270 @@ struct inbox_t
         lua_State* fiber;
         value_type msg;
         bool wake_on_destruct = false;
+
+        // Set on every message of a send_many() batch but the last one. The
+        // sender is only woken up when the last message is received (or
+        // dropped).
+        bool batch_member = false;
+
+        // Queued in the mailbox's spare capacity. Nobody waits on it and
+        // inbox_t::nbuffered must be updated once it leaves the inbox.
+        bool buffered = false;
+
+        // Set for rendezvous sends that can be interrupted. A message whose
+        // ticket was settled while still queued was withdrawn and must be
+        // skipped.
+        boost::intrusive_ptr<send_ticket> ticket;
+
+        // --trace flow linking send and receive (0 if not traced)
+        std::uint64_t trace_flow_id = 0;
     };
 
+    // Node of the lock-free queue through which other threads hand messages
+    // over to this inbox.
+    struct queued_message
+    {
+        sender_state sender;
+        queued_message* next = nullptr;
+    };
+
+    inbox_t() = default;
+    inbox_t(const inbox_t&) = delete;
+    inbox_t& operator=(const inbox_t&) = delete;
+    ~inbox_t();
+
+    // Producer side. Links the chain `newest`...`oldest` (each node points to
+    // the one sent before it) in front of `pending`. Fails if the inbox was
+    // closed in which case the chain is left untouched. After a successful
+    // push, whoever manages to clear `receiver_parked` must wake the
+    // receiver up on its strand.
+    bool push(queued_message* newest, queued_message* oldest) noexcept
+    {
+        auto head = pending.load(std::memory_order_relaxed);
+        do {
+            if (head == closed_queue())
+                return false;
+            oldest->next = head;
+        } while (!pending.compare_exchange_weak(head, newest));
+        return true;
+    }
+
+    // Consumer side (receiver's strand). Detaches every message pushed so far
+    // (newest first). Must not be called once the inbox was closed.
+    queued_message* take_pending() noexcept
+    {
+        if (pending.load(std::memory_order_relaxed) == nullptr)
+            return nullptr;
+        return pending.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    // Consumer side. Makes further push() calls fail and returns the messages
+    // that were still pending (newest first).
+    queued_message* close_pending() noexcept
+    {
+        auto head = pending.exchange(closed_queue(), std::memory_order_acquire);
+        return head == closed_queue() ? nullptr : head;
+    }
+
+    static queued_message* closed_queue() noexcept
+    {
+        return reinterpret_cast<queued_message*>(std::uintptr_t{1});
+    }
+
+    static void delete_chain(queued_message* m) noexcept
+    {
+        while (m) {
+            auto next = m->next;
+            delete m;
+            m = next;
+        }
+    }
+
+    enum class overflow_policy
+    {
+        // senders wait for the receiver once the mailbox is full
+        block,
+        // the oldest buffered message is dropped to make room
+        drop_oldest,
+    };
+
+    enum class buffer_slot
+    {
+        // no room, the message must be sent as a rendezvous (or refused)
+        none,
+        reserved,
+        // drop_oldest only. The receiver didn't get to trim its mailbox in
+        // time (see max_buffered()) so the new message is discarded instead.
+        discarded,
+    };
+
+    // Reserves room for a buffered message. Called from the sender's thread.
+    buffer_slot try_reserve_buffer_slot() noexcept
+    {
+        auto cap = capacity.load(std::memory_order_relaxed);
+        if (cap == 0)
+            return buffer_slot::none;
+
+        std::size_t max = cap;
+        auto ret = buffer_slot::none;
+        if (overflow.load(std::memory_order_relaxed) ==
+            overflow_policy::drop_oldest) {
+            max = max_buffered(cap);
+            ret = buffer_slot::discarded;
+        }
+
+        auto n = nbuffered.load(std::memory_order_relaxed);
+        while (n < max) {
+            if (nbuffered.compare_exchange_weak(n, n + 1))
+                return buffer_slot::reserved;
+        }
+        return ret;
+    }
+
+    // With drop_oldest, messages past the capacity are only trimmed once the
+    // receiver's strand runs vm_context::collect_inbox() (senders schedule it
+    // through `trim_pending`). A receiver that doesn't get to run meanwhile
+    // holds at most this many buffered messages.
+    static std::size_t max_buffered(std::size_t cap) noexcept
+    {
+        return cap > std::numeric_limits<std::size_t>::max() / 2 ?
+            std::numeric_limits<std::size_t>::max() : cap * 2;
+    }
+
     lua_State* recv_fiber = nullptr;
+    // Only touched from the receiver's strand. Messages pushed by senders are
+    // moved here by vm_context::collect_inbox().
     std::deque<sender_state> incoming;
+    // Lock-free MPSC queue (an intrusive LIFO reversed by the consumer).
+    // Senders push to it directly so delivering a message doesn't cost a
+    // strand post unless the receiver is parked.
+    std::atomic<queued_message*> pending = nullptr;
+    // Deadline for receive{timeout=...}. Created on first use and reused by
+    // later receives (only one fiber may wait on the inbox at a time).
+    // `recv_generation` changes on every receive that suspends so a stale
+    // expiration is ignored.
+    std::optional<asio::steady_timer> recv_timer;
+    std::uint64_t recv_generation = 0;
+
+    void cancel_recv_timer() noexcept
+    {
+        if (!recv_timer)
+            return;
+
+        try {
+            recv_timer->cancel();
+        } catch (const boost::system::system_error&) {}
+    }
+
+    // Messages pushed but not collected yet. Together with the collected
+    // backlog it gives other threads a cheap (approximate) view of how busy
+    // the receiver is.
+    std::atomic_size_t npending = 0;
+    // Set by the receiver right before it suspends in receive(). A stale value
+    // only costs a spurious (harmless) wake-up post.
+    std::atomic_bool receiver_parked = false;
     bool open = true;
     bool imported = false;
     std::atomic_size_t nsenders = 0;
     std::shared_ptr<vm_context> work_guard;
+
+    // Messages up to `capacity` are buffered and their senders don't wait for
+    // the receiver. 0 makes every send a rendezvous.
+    std::atomic_size_t capacity = 0;
+    std::atomic<overflow_policy> overflow = overflow_policy::block;
+    // buffered messages not yet received (including the ones still in
+    // flight to this VM's strand)
+    std::atomic_size_t nbuffered = 0;
+    // drop_oldest only. Set while a trim of the mailbox is posted to the
+    // receiver's strand.
+    std::atomic_bool trim_pending = false;
+    // messages withdrawn by their senders that are still queued (a send_many()
+    // batch counts once)
+    std::atomic_size_t nwithdrawn = 0;
+};
+
+namespace detail {
+// Per-VM lua_Alloc. Small blocks (tables, strings, closures, userdata...) are
+// recycled through size-class freelists carved out of big chunks that are only
+// handed back to the system when the VM is closed. Bigger blocks go straight to
+// malloc(). A VM only runs on one thread at a time so there's no
+// synchronization.
+//
+// It also does the VM's memory accounting. If LuaJIT refuses custom allocators
+// (x86-64 without GC64), the allocator just wraps LuaJIT's own to keep the
+// accounting (see wrap()).
+class lua_allocator
+{
+public:
+    lua_allocator() = default;
+    ~lua_allocator();
+
+    lua_allocator(const lua_allocator&) = delete;
+    lua_allocator& operator=(const lua_allocator&) = delete;
+
+    static void* alloc(void* ud, void* ptr, std::size_t osize,
+                       std::size_t nsize);
+
+    // Install itself on top of the allocator currently used by `L`.
+    void wrap(lua_State* L);
+
+    // Must be called before lua_close() if wrap() was used (LuaJIT only
+    // destroys its own allocator's arena if it's still installed).
+    void unwrap(lua_State* L) noexcept;
+
+    // Only safe to call after lua_close().
+    void release() noexcept;
+
+    std::size_t memory_usage() const noexcept
+    {
+        return used;
+    }
+
+    std::size_t peak_memory_usage() const noexcept
+    {
+        return peak;
+    }
+
+    // Allocations that'd grow the usage past this value fail. 0 means
+    // unlimited.
+    std::size_t memory_limit = 0;
+
+private:
+    static constexpr std::size_t granularity = 16;
+    static constexpr std::size_t max_small_size = 256;
+    static constexpr std::size_t chunk_size = 256 * 1024;
+
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    struct chunk_header
+    {
+        chunk_header* next;
+    };
+
+    static constexpr std::size_t size_class(std::size_t size)
+    {
+        return (size - 1) / granularity;
+    }
+
+    void* allocate(std::size_t size);
+    void deallocate(void* ptr, std::size_t size) noexcept;
+    void* reallocate(void* ptr, std::size_t osize, std::size_t nsize);
+
+    free_block* freelists[max_small_size / granularity] = {};
+    chunk_header* chunks = nullptr;
+    char* chunk_next = nullptr;
+    char* chunk_end = nullptr;
+
+    lua_Alloc wrapped_alloc = nullptr;
+    void* wrapped_ud = nullptr;
+
+    std::size_t used = 0;
+    std::size_t peak = 0;
 };
+} // namespace detail
 
 // This class represents a node to be destroyed when the VM finishes
 // prematurely. It can be used to register cleanup code (the `cancel()` method).
@@ -533,6 +1259,53 @@ public:
     bool shared_ownership;
 };
 
+// Per-fiber state touched on every suspension/resumption. It's kept out of the
+// Lua fiber data table (see FiberDataIndex) so hot paths such as
+// fiber_resume() and set_interrupter() don't pay for table lookups. Use
+// vm_context::current_fiber_data() or vm_context::fiber_data() to reach it.
+struct native_fiber_data
+{
+    enum class interrupter_type: unsigned char
+    {
+        none,
+        cancellation_signal, //< emit terminal cancellation on `cancel_signal`
+        lua_function //< stored at FiberDataIndex::INTERRUPTER
+    };
+
+    bool interruption_disabled() const noexcept
+    {
+        return interruption_always_disabled ||
+            interruption_disabled_count > 0;
+    }
+
+    void reset() noexcept
+    {
+        interruption_disabled_count = 0;
+        suspension_disallowed_count = 0;
+        interrupted = false;
+        interruption_always_disabled = false;
+        interrupter = interrupter_type::none;
+        cancel_signal.slot().clear();
+        trace_async_op.clear();
+    }
+
+    lua_Integer interruption_disabled_count = 0;
+    lua_Integer suspension_disallowed_count = 0;
+    bool interrupted = false;
+
+    // Modules' fibers and the async event thread can never be interrupted. Lua
+    // code is still allowed to change `interruption_disabled_count` on them
+    // with no effect.
+    bool interruption_always_disabled = false;
+
+    interrupter_type interrupter = interrupter_type::none;
+    asio::cancellation_signal cancel_signal;
+
+    // --trace: name of the async operation the fiber is suspended on (empty if
+    // none)
+    std::string trace_async_op;
+};
+
 class vm_context: public std::enable_shared_from_this<vm_context>
 {
 public:
@@ -546,8 +1319,8 @@ public:
         static constexpr struct arguments_t {} arguments{};
 
         // Convert from `asio::error::operation_aborted` to `errc::interrupted`
-        // iff `FiberDataIndex::INTERRUPTED` has been set for the fiber about to
-        // be resumed.
+        // iff `native_fiber_data::interrupted` has been set for the fiber about
+        // to be resumed.
         //
         // If the implementation for your IO operation has the following
         // workflow:
@@ -594,9 +1367,9 @@ public:
     vm_context& operator=(const vm_context&) = delete;
     vm_context& operator=(vm_context&&) = delete;
 
-    const strand_type& strand()
+    counting_executor<strand_type> strand()
     {
-        return strand_;
+        return counting_executor<strand_type>{strand_, stats_};
     }
 
     remap_post_to_defer<strand_type> strand_using_defer()
@@ -623,6 +1396,7 @@ public:
     lua_State* async_event_thread()
     {
         current_fiber_ = async_event_thread_;
+        current_fiber_data_ = async_event_thread_data_;
         return async_event_thread_;
     }
 
@@ -633,6 +1407,36 @@ public:
         return current_fiber_;
     }
 
+    native_fiber_data& current_fiber_data()
+    {
+        assert(current_fiber_data_);
+        return *current_fiber_data_;
+    }
+
+    native_fiber_data& fiber_data(lua_State* fiber)
+    {
+        auto it = fiber_data_.find(fiber);
+        assert(it != fiber_data_.end());
+        return it->second;
+    }
+
+    // Must be called for every new fiber before it runs. A stale entry for a
+    // collected thread that happened to share the same address is reset.
+    //
+    // Throws: std::bad_alloc
+    native_fiber_data& new_fiber_data(lua_State* fiber)
+    {
+        auto [it, inserted] = fiber_data_.try_emplace(fiber);
+        if (!inserted)
+            it->second.reset();
+        return it->second;
+    }
+
+    void erase_fiber_data(lua_State* fiber)
+    {
+        fiber_data_.erase(fiber);
+    }
+
     bool valid()
     {
         return valid_;
@@ -644,6 +1448,57 @@ public:
     void notify_errmem();
     void notify_exit_request();
 
+    std::size_t memory_usage() const noexcept
+    {
+        return allocator_.memory_usage();
+    }
+
+    std::size_t peak_memory_usage() const noexcept
+    {
+        return allocator_.peak_memory_usage();
+    }
+
+    std::size_t memory_limit() const noexcept
+    {
+        return allocator_.memory_limit;
+    }
+
+    // Allocations that'd take the VM past `limit` bytes fail with LUA_ERRMEM
+    // (which closes the VM just like a real out-of-memory condition would). 0
+    // means unlimited.
+    void memory_limit(std::size_t limit) noexcept
+    {
+        allocator_.memory_limit = limit;
+    }
+
+    const vm_scheduler_stats& stats() const noexcept
+    {
+        return *stats_;
+    }
+
+    // Moves the messages pushed by senders into `inbox.incoming` (in the order
+    // they were sent). Must be called from the strand before looking at
+    // `inbox.incoming`.
+    void collect_inbox();
+
+    // Closes the inbox and drops every queued message (waking up their
+    // senders).
+    void close_inbox();
+
+    // Number of messages waiting in the inbox. Safe to call from any thread.
+    std::size_t inbox_backlog() const noexcept
+    {
+        return stats_->inbox_backlog.load(std::memory_order_relaxed) +
+            inbox.npending.load(std::memory_order_relaxed);
+    }
+
+    // Must be called after every change to `inbox.incoming`
+    void sync_inbox_backlog() noexcept
+    {
+        stats_->inbox_backlog.store(
+            inbox.incoming.size(), std::memory_order_relaxed);
+    }
+
     void notify_deadlock(std::string msg);
     void notify_cleanup_error(lua_State* coro);
 
@@ -652,10 +1507,28 @@ public:
         return this == appctx.master_vm.load().lock().get();
     }
 
+    // The core this VM runs on (thread-per-core mode only)
+    app_context::core_context* core() const noexcept
+    {
+        return core_;
+    }
+
+    void core(app_context::core_context& c) noexcept
+    {
+        assert(core_ == nullptr);
+        core_ = &c;
+        ++c.nvms;
+    }
+
+    // Throws: std::bad_alloc
     void async_event_thread(lua_State* new_async_event_thread)
     {
         assert(async_event_thread_ == nullptr);
+        auto& data = new_fiber_data(new_async_event_thread);
+        data.interruption_always_disabled = true;
+        data.suspension_disallowed_count = 1;
         async_event_thread_ = new_async_event_thread;
+        async_event_thread_data_ = &data;
     }
 
     lua_State* async_event_thread_
@@ -667,6 +1540,9 @@ public:
     // Use it to detect cycles when loading modules from external packages.
     std::set<std::string, TransparentStringComp> visited_external_packages;
 
+    // Bitmask of extra modules already initialized (see init_extra_module()).
+    std::uint32_t initialized_extra_modules = 0;
+
     inbox_t inbox;
 
     boost::intrusive::list<
@@ -679,18 +1555,39 @@ public:
     // can be empty
     std::weak_ptr<asio::io_context> ioctxref;
 
+    // Root frame for this VM's samples in --profile output (the actor's
+    // module)
+    std::string profiler_label;
+
+    // --trace process id
+    std::uint64_t trace_pid = 0;
+
 private:
+    // lua_resume() plus scheduler accounting
+    int resume(lua_State* fiber, int narg);
+
+    // Returns the VM attached before so it can be given back to
+    // detach_profiler() (resume() calls might nest)
+    vm_context* attach_profiler();
+    void detach_profiler(vm_context* previous);
+
     void fiber_epilogue(int resume_result);
 
     strand_type strand_;
+    std::shared_ptr<vm_scheduler_stats> stats_;
     bool valid_;
     bool lua_errmem;
     bool exit_request;
     bool suppress_tail_errors = false;
+    detail::lua_allocator allocator_;
     lua_State* L_;
     lua_State* current_fiber_;
+    native_fiber_data* current_fiber_data_ = nullptr;
+    native_fiber_data* async_event_thread_data_ = nullptr;
+    std::unordered_map<lua_State*, native_fiber_data> fiber_data_;
     std::vector<std::string> deadlock_errors;
     void* failed_cleanup_handler_coro = nullptr;
+    app_context::core_context* core_ = nullptr;
 };
 
 vm_context& get_vm_context(lua_State* L);
@@ -929,6 +1826,7 @@ void vm_context::fiber_resume(lua_State* new_current_fiber, HanaSet&& options)
     assert(lua_status(new_current_fiber) == 0 ||
            lua_status(new_current_fiber) == LUA_YIELD);
     current_fiber_ = new_current_fiber;
+    current_fiber_data_ = &fiber_data(new_current_fiber);
 
     int narg = 0;
 
@@ -947,18 +1845,9 @@ void vm_context::fiber_resume(lua_State* new_current_fiber, HanaSet&& options)
                         // until the next interruption/suspendion point anyway).
                         if (ec == asio::error::operation_aborted) {
                             // A call to `fib:interrupt()` will set
-                            // `FiberDataIndex::INTERRUPTED` for `fib`
+                            // `native_fiber_data::interrupted` for `fib`
                             // automatically.
-                            rawgetp(new_current_fiber, LUA_REGISTRYINDEX,
-                                    &fiber_list_key);
-                            lua_pushthread(new_current_fiber);
-                            lua_rawget(new_current_fiber, -2);
-                            lua_rawgeti(new_current_fiber, -1,
-                                        FiberDataIndex::INTERRUPTED);
-                            bool interrupted =
-                                lua_toboolean(new_current_fiber, -1);
-                            lua_pop(new_current_fiber, 3);
-                            if (interrupted)
+                            if (current_fiber_data_->interrupted)
                                 std_ec = errc::interrupted;
                         }
                     } else if (has_fast_auto_detect_interrupt) {
@@ -1006,7 +1895,11 @@ void vm_context::fiber_resume(lua_State* new_current_fiber, HanaSet&& options)
         return;
     }
 
-    if (hana::none_of(options, is_skip_clear_interrupter)) {
+    if (
+        hana::none_of(options, is_skip_clear_interrupter) &&
+        current_fiber_data_->interrupter !=
+        native_fiber_data::interrupter_type::none
+    ) {
         // There is no need for a try-catch block here. Only throwing function
         // in set_interrupter() is lua_rawseti(). lua_rawseti() shouldn't throw
         // on LUA_ERRMEM for `nil` assignment.
@@ -1014,7 +1907,7 @@ void vm_context::fiber_resume(lua_State* new_current_fiber, HanaSet&& options)
         set_interrupter(new_current_fiber, *this);
     }
 
-    int res = lua_resume(new_current_fiber, narg);
+    int res = resume(new_current_fiber, narg);
     fiber_epilogue(res);
 }
 
@@ -1065,7 +1958,9 @@ inline actor_address::~actor_address()
             return;
 
         vm_ctx->inbox.recv_fiber = nullptr;
+        vm_ctx->inbox.receiver_parked = false;
         vm_ctx->inbox.work_guard.reset();
+        vm_ctx->inbox.cancel_recv_timer();
 
         auto opt_args = vm_context::options::arguments;
         vm_ctx->fiber_resume(
@@ -1075,6 +1970,13 @@ inline actor_address::~actor_address()
     }, std::allocator<void>{});
 }
 
+inline inbox_t::~inbox_t()
+{
+    auto head = pending.load(std::memory_order_acquire);
+    if (head != closed_queue())
+        delete_chain(head);
+}
+
 inline inbox_t::sender_state::sender_state(vm_context& vm_ctx)
     : vm_ctx(vm_ctx.shared_from_this())
     , work_guard(vm_ctx.work_guard())
@@ -1108,16 +2010,26 @@ inline inbox_t::sender_state::sender_state(sender_state&& o)
     , fiber(o.fiber)
     , msg(std::move(o.msg))
     , wake_on_destruct(o.wake_on_destruct)
+    , batch_member(o.batch_member)
+    , buffered(o.buffered)
+    , ticket(std::move(o.ticket))
+    , trace_flow_id(o.trace_flow_id)
 {
     o.wake_on_destruct = false;
 }
 
 inline inbox_t::sender_state::~sender_state()
 {
-    if (!wake_on_destruct)
+    if (!wake_on_destruct || batch_member || buffered)
         return;
 
-    vm_ctx->strand().post([vm_ctx=vm_ctx, fiber=fiber]() {
+    if (ticket && !ticket->settle())
+        return;
+
+    vm_ctx->strand().post([vm_ctx=vm_ctx, fiber=fiber, ticket=ticket]() {
+        if (ticket && vm_ctx->valid())
+            ticket->settle_sender(vm_ctx->L(), /*received=*/false);
+
         auto opt_args = vm_context::options::arguments;
         vm_ctx->fiber_resume(
             fiber,
@@ -1131,8 +2043,14 @@ inline
 inbox_t::sender_state&
 inbox_t::sender_state::operator=(inbox_t::sender_state&& o)
 {
-    if (wake_on_destruct) {
-        vm_ctx->strand().post([vm_ctx=vm_ctx, fiber=fiber]() {
+    if (
+        wake_on_destruct && !batch_member && !buffered &&
+        (!ticket || ticket->settle())
+    ) {
+        vm_ctx->strand().post([vm_ctx=vm_ctx, fiber=fiber, ticket=ticket]() {
+            if (ticket && vm_ctx->valid())
+                ticket->settle_sender(vm_ctx->L(), /*received=*/false);
+
             auto opt_args = vm_context::options::arguments;
             vm_ctx->fiber_resume(
                 fiber,
@@ -1149,9 +2067,29 @@ inbox_t::sender_state::operator=(inbox_t::sender_state&& o)
     fiber = o.fiber;
     msg = std::move(o.msg);
     wake_on_destruct = o.wake_on_destruct;
+    batch_member = o.batch_member;
+    buffered = o.buffered;
+    ticket = std::move(o.ticket);
+    trace_flow_id = o.trace_flow_id;
 
     o.wake_on_destruct = false;
     return *this;
 }
 
 } // namespace emilua
+
+template<class T, class Executor, class Allocator>
+struct boost::asio::associated_allocator<
+    boost::asio::executor_binder<T, emilua::remap_post_to_defer<Executor>>,
+    Allocator>
+{
+    using type = emilua::recycling_handler_allocator<void>;
+
+    static type get(
+        const boost::asio::executor_binder<
+            T, emilua::remap_post_to_defer<Executor>>& b,
+        const Allocator& = Allocator()) noexcept
+    {
+        return b.get_executor().handler_allocator();
+    }
+};
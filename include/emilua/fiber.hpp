@@ -31,6 +31,11 @@ struct fiber_handle
 };
 
 void init_fiber_module(lua_State* L);
+
+// Removes `fiber` from the fiber list. `fiber` must be finished and no handle
+// may refer to it anymore. Fibers that finished without errors are kept in a
+// per-VM pool to be reused by spawn().
+void release_fiber(lua_State* fiber);
 void print_panic(const lua_State* L, bool is_main, std::string_view error,
                  std::string_view stacktrace);
 
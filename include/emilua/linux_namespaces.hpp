@@ -37,12 +37,19 @@ struct linux_container_start_vm_request
     action stderr_action;
     std::uint8_t stderr_has_color;
     std::uint8_t has_lua_hook;
+    // how many pre-spawned processes (zygotes) the supervisor should keep ready
+    // for further requests with the same options
+    std::uint8_t nzygotes;
+    std::uint64_t memory_limit;
 };
 
 struct linux_container_start_vm_reply
 {
     pid_t childpid;
     int error;
+    // whether childpid was taken from the zygotes instead of clone()d for this
+    // request
+    std::uint8_t from_zygote;
 };
 
 inline bool is_snan(std::uint64_t as_i)
@@ -63,7 +70,10 @@ struct linux_container_message
         string          = 3,
         file_descriptor = 4,
         actor_address   = 5,
-        nil             = 6
+        nil             = 6,
+        // a string longer than 255 bytes; its contents live in a sealed memfd
+        // sent along as one of the message's file descriptors
+        large_string    = 7
     };
 
     union {
@@ -86,7 +96,7 @@ struct linux_container_inbox_op
 {
     linux_container_inbox_op(vm_context& vm_ctx,
                              linux_container_inbox_service* service)
-        : executor{vm_ctx.strand()}
+        : executor{vm_ctx.strand().get_inner_executor()}
         , vm_ctx{vm_ctx.weak_from_this()}
         , service{service}
     {}
@@ -102,9 +112,11 @@ private:
 
 struct linux_container_inbox_service : public pending_operation
 {
-    linux_container_inbox_service(asio::io_context& ioctx, int inboxfd)
+    linux_container_inbox_service(asio::io_context& ioctx, int inboxfd,
+                                  bool accept_large_strings = false)
         : pending_operation{/*shared_ownership=*/false}
         , sock{ioctx}
+        , accept_large_strings{accept_large_strings}
     {
         asio::local::datagram_protocol protocol;
         boost::system::error_code ignored_ec;
@@ -127,6 +139,14 @@ struct linux_container_inbox_service : public pending_operation
 
     asio::local::datagram_protocol::socket sock;
     bool running = false;
+
+    // Strings longer than 255 bytes (linux_container_message::large_string)
+    // are only accepted by the inbox of the container itself, i.e. they only
+    // flow into sandboxes. Anywhere else they'd let an untrusted container
+    // push up to MAX_MEMBERS_NUMBER memfds of
+    // EMILUA_CONFIG_LINUX_NAMESPACES_MESSAGE_MAX_STRING_SIZE bytes with every
+    // datagram, so they're handled as a misbehaving sender.
+    bool accept_large_strings;
 };
 
 } // namespace emilua
@@ -5,7 +5,7 @@
 
 #pragma once
 
-#include <emilua/core.hpp>
+#include <emilua/state.hpp>
 
 #include <boost/preprocessor/list/cat.hpp>
 
@@ -67,6 +67,11 @@ public:
     // NOTE: If the function fails, it might be called again if Lua code try to
     // import the same module again.
     //
+    // NOTE: Modules other than the core ones (see extra_module in
+    // emilua/state.hpp) are only initialized once the VM imports them. If the
+    // plugin uses their metatables directly (e.g. it pushes an ip.tcp.socket),
+    // it must call init_extra_module() first.
+    //
     // NOTE: There is no such a thing as an "async" native plugin load (e.g. a
     // plugin that suspends the caller module fiber). It'd be a hassle to
     // implement that. Just apply "lazy loading" techniques on the next layer if
@@ -16,7 +16,7 @@ struct Socket
     Socket(Args&&... args) : socket{std::forward<Args>(args)...} {}
 
     T socket;
-    std::size_t nbusy = 0; //< TODO: use to errcheck transfers between actors
+    std::size_t nbusy = 0; //< used to errcheck transfers between actors
 };
 
 } // namespace emilua
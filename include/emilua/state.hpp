@@ -9,6 +9,8 @@
 
 #include <boost/asio/io_context.hpp>
 
+#include <mutex>
+
 namespace emilua {
 
 enum ContextType: lua_Integer
@@ -25,4 +27,75 @@ std::shared_ptr<vm_context> make_vm(boost::asio::io_context& ioctx,
                                     std::filesystem::path entry_point,
                                     ContextType lua_context);
 
+// Modules that aren't needed by the runtime itself. They're only initialized
+// once the VM first needs them (usually on require()).
+enum class extra_module : unsigned
+{
+    generic_error,
+    time,
+    filesystem,
+    json,
+    ip,
+    tls,
+    system,
+    serial_port,
+    regex,
+    stream,
+    pipe,
+#if BOOST_OS_UNIX
+    unix_sockets, //< `unix` may be a predefined macro
+#endif // BOOST_OS_UNIX
+#if EMILUA_CONFIG_ENABLE_HTTP
+    http,
+    websocket,
+#endif // EMILUA_CONFIG_ENABLE_HTTP
+#if EMILUA_CONFIG_ENABLE_FILE_IO
+    file,
+#endif // EMILUA_CONFIG_ENABLE_FILE_IO
+};
+
+// Runs the module's init function (and the ones from the modules it depends
+// on) unless it already ran for this VM. Code that uses metatables from an
+// extra module without going through require() must call it first.
+void init_extra_module(lua_State* L, extra_module module);
+
+// Same as make_vm(), but takes an already initialized VM from ioctx's
+// vm_pool_service if app_context::vm_pool_size is non-zero.
+std::shared_ptr<vm_context> make_vm_from_pool(
+    boost::asio::io_context& ioctx, emilua::app_context& appctx,
+    std::filesystem::path entry_point, ContextType lua_context);
+
+// VMs that already ran every init_*() function, but didn't load any module
+// yet. There is one pool per io_context and refills run as handlers on that
+// io_context. Pooled VMs don't count towards app_context::nvms nor
+// show up in app_context::vms.
+class vm_pool_service : public boost::asio::execution_context::service
+{
+public:
+    using key_type = vm_pool_service;
+
+    explicit vm_pool_service(boost::asio::execution_context& ctx);
+
+    void shutdown() override;
+
+    // Returns nullptr if the pool is empty. Schedules a refill according to
+    // app_context::vm_pool_refill_policy.
+    std::shared_ptr<vm_context> take(app_context& appctx);
+
+    // Schedules the pool to be filled up to app_context::vm_pool_size
+    void prewarm(app_context& appctx);
+
+    static boost::asio::io_context::id id;
+
+private:
+    // must be called with `mtx` locked
+    void schedule_refill(app_context& appctx);
+    void refill(app_context& appctx);
+
+    boost::asio::io_context& ioctx;
+    std::vector<std::shared_ptr<vm_context>> vms;
+    bool refill_pending = false;
+    std::mutex mtx;
+};
+
 } // namespace emilua
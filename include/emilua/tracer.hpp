@@ -0,0 +1,42 @@
+/* Copyright (c) 2023 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#pragma once
+
+#include <emilua/core.hpp>
+
+namespace emilua {
+
+// --trace support. Events use the Chrome trace event format (also understood
+// by Perfetto). Each VM is shown as a process and each OS thread as a thread.
+//
+// Callers must check `appctx.tracer` first. None of these functions do it.
+
+// Names the VM's track after its module. Must be called before any other
+// event is recorded for the VM.
+void trace_vm_start(vm_context& vm_ctx, std::string_view name);
+
+void trace_fiber_spawn(vm_context& vm_ctx, lua_State* new_fiber);
+
+// A fiber ran from `start` until it yielded or finished
+void trace_fiber_slice(vm_context& vm_ctx, lua_State* fiber,
+                       std::chrono::steady_clock::time_point start,
+                       std::chrono::steady_clock::time_point end,
+                       bool finished);
+
+// The current fiber is about to suspend on an async operation. The operation
+// is named after the Lua function being called. The operation completes
+// (trace_async_op_end()) when the fiber is resumed.
+void trace_async_op_begin(vm_context& vm_ctx);
+void trace_async_op_end(vm_context& vm_ctx, lua_State* fiber);
+
+// Returns the flow id that links both ends
+std::uint64_t trace_message_send(vm_context& vm_ctx);
+void trace_message_receive(vm_context& vm_ctx, std::uint64_t flow_id);
+
+// Throws: std::ios_base::failure
+void write_trace(app_context& appctx, const std::filesystem::path& path);
+
+} // namespace emilua
@@ -16,6 +16,7 @@ namespace emilua {
 extern char unix_key;
 extern char unix_datagram_socket_mt_key;
 extern char unix_stream_socket_mt_key;
+extern char unix_seqpacket_socket_mt_key;
 
 // TODO: submit PR to Boost.Asio
 struct seqpacket_protocol
@@ -3,7 +3,11 @@
    Distributed under the Boost Software License, Version 1.0. (See accompanying
    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
 
+#include <algorithm>
 #include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <locale>
 #include <new>
 
@@ -17,8 +21,13 @@
 
 #include <emilua/detail/core.hpp>
 #include <emilua/fiber.hpp>
+#include <emilua/tracer.hpp>
 #include <emilua/actor.hpp>
 
+#if BOOST_OS_UNIX
+#include <sys/mman.h>
+#endif // BOOST_OS_UNIX
+
 namespace emilua {
 
 bool stdout_has_color;
@@ -110,6 +119,46 @@ std::error_condition rdf_error_category::default_error_condition(int code) const
     }
 }
 
+app_context::core_context& app_context::pick_core()
+{
+    assert(cores.size() > 0);
+    switch (core_placement_policy) {
+    case placement_policy::round_robin:
+        return cores[
+            next_core.fetch_add(1, std::memory_order_relaxed) % cores.size()];
+    case placement_policy::least_loaded:
+    default:
+        return *std::min_element(
+            cores.begin(), cores.end(),
+            [](const core_context& a, const core_context& b) {
+                return a.nvms.load(std::memory_order_relaxed) <
+                    b.nvms.load(std::memory_order_relaxed);
+            });
+    }
+}
+
+void app_context::release_core_work_guards()
+{
+    if (core_work_guards_released.exchange(true))
+        return;
+
+    core_work_guards.clear();
+}
+
+std::vector<app_context::vm_stats_entry> app_context::vm_stats()
+{
+    std::vector<vm_stats_entry> ret;
+    std::lock_guard guard{vms_mtx};
+    ret.reserve(vms.size());
+    for (auto vm: vms) {
+        auto& e = ret.emplace_back(
+            vm_stats_entry{vm->weak_from_this(), vm->stats().snapshot()});
+        // also count the messages not collected from the inbox yet
+        e.stats.inbox_backlog = vm->inbox_backlog();
+    }
+    return ret;
+}
+
 void app_context::init_log_domain(std::string_view name, int& log_level)
 {
     auto it = app_env.find("EMILUA_LOG_LEVELS");
@@ -186,23 +235,307 @@ properties_service::properties_service(asio::execution_context& ctx)
 void properties_service::shutdown()
 {}
 
+namespace detail {
+lua_allocator::~lua_allocator()
+{
+    release();
+}
+
+void* lua_allocator::alloc(void* ud, void* ptr, std::size_t osize,
+                           std::size_t nsize)
+{
+    auto self = static_cast<lua_allocator*>(ud);
+    if (!ptr)
+        osize = 0;
+
+    if (
+        self->memory_limit != 0 && nsize > osize &&
+        self->used + (nsize - osize) > self->memory_limit
+    ) {
+        return nullptr;
+    }
+
+    void* ret;
+    if (self->wrapped_alloc) {
+        ret = self->wrapped_alloc(self->wrapped_ud, ptr, osize, nsize);
+    } else if (nsize == 0) {
+        if (ptr)
+            self->deallocate(ptr, osize);
+        ret = nullptr;
+    } else if (!ptr) {
+        ret = self->allocate(nsize);
+    } else {
+        ret = self->reallocate(ptr, osize, nsize);
+    }
+
+    if (ret || nsize == 0) {
+        // blocks allocated before wrap() aren't exactly accounted for
+        self->used -= std::min(self->used, osize);
+        self->used += nsize;
+        self->peak = std::max(self->peak, self->used);
+    }
+    return ret;
+}
+
+void lua_allocator::wrap(lua_State* L)
+{
+    assert(!wrapped_alloc);
+    wrapped_alloc = lua_getallocf(L, &wrapped_ud);
+    used = static_cast<std::size_t>(lua_gc(L, LUA_GCCOUNT, 0)) * 1024 +
+        lua_gc(L, LUA_GCCOUNTB, 0);
+    peak = used;
+    lua_setallocf(L, alloc, this);
+}
+
+void lua_allocator::unwrap(lua_State* L) noexcept
+{
+    if (!wrapped_alloc)
+        return;
+
+    lua_setallocf(L, wrapped_alloc, wrapped_ud);
+    wrapped_alloc = nullptr;
+}
+
+void lua_allocator::release() noexcept
+{
+    while (chunks) {
+        auto next = chunks->next;
+#if BOOST_OS_UNIX
+        munmap(chunks, chunk_size);
+#else // BOOST_OS_UNIX
+        std::free(chunks);
+#endif // BOOST_OS_UNIX
+        chunks = next;
+    }
+
+    std::fill(std::begin(freelists), std::end(freelists), nullptr);
+    chunk_next = chunk_end = nullptr;
+}
+
+void* lua_allocator::allocate(std::size_t size)
+{
+    if (size > max_small_size)
+        return std::malloc(size);
+
+    auto& head = freelists[size_class(size)];
+    if (head) {
+        auto ret = head;
+        head = head->next;
+        return ret;
+    }
+
+    std::size_t block_size = (size_class(size) + 1) * granularity;
+    if (static_cast<std::size_t>(chunk_end - chunk_next) < block_size) {
+        // Chunks are mapped directly (instead of going through malloc()) so
+        // the memory is given back to the OS as soon as the VM is closed.
+#if BOOST_OS_UNIX
+        void* mem = mmap(nullptr, chunk_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+            return nullptr;
+#else // BOOST_OS_UNIX
+        void* mem = std::malloc(chunk_size);
+        if (!mem)
+            return nullptr;
+#endif // BOOST_OS_UNIX
+
+        static_assert(sizeof(chunk_header) <= granularity);
+        auto chunk = static_cast<chunk_header*>(mem);
+        chunk->next = chunks;
+        chunks = chunk;
+        chunk_next = static_cast<char*>(mem) + granularity;
+        chunk_end = static_cast<char*>(mem) + chunk_size;
+    }
+
+    auto ret = chunk_next;
+    chunk_next += block_size;
+    return ret;
+}
+
+void lua_allocator::deallocate(void* ptr, std::size_t size) noexcept
+{
+    if (size > max_small_size) {
+        std::free(ptr);
+        return;
+    }
+
+    auto block = static_cast<free_block*>(ptr);
+    auto& head = freelists[size_class(size)];
+    block->next = head;
+    head = block;
+}
+
+void* lua_allocator::reallocate(void* ptr, std::size_t osize,
+                                std::size_t nsize)
+{
+    if (osize > max_small_size && nsize > max_small_size) {
+        void* ret = std::realloc(ptr, nsize);
+        // Lua assumes shrinking never fails
+        return (!ret && nsize < osize) ? ptr : ret;
+    }
+
+    if (
+        osize <= max_small_size && nsize <= max_small_size &&
+        size_class(osize) == size_class(nsize)
+    ) {
+        return ptr;
+    }
+
+    void* ret = allocate(nsize);
+    if (!ret) {
+        // Lua assumes shrinking never fails. The old block will then be
+        // recycled as a smaller one (blocks from malloc() end up living until
+        // process exit, but we're already out of memory anyway).
+        return (nsize < osize) ? ptr : nullptr;
+    }
+
+    std::memcpy(ret, ptr, std::min(osize, nsize));
+    deallocate(ptr, osize);
+    return ret;
+}
+} // namespace detail
+
+static int lua_panic(lua_State* L)
+{
+    const char* msg = lua_tostring(L, -1);
+    if (!msg)
+        msg = "?";
+    fmt::print(
+        nowide::cerr,
+        FMT_STRING("PANIC: unprotected error in call to Lua API ({})\n"), msg);
+    return 0;
+}
+
+static lua_State* new_lua_state(detail::lua_allocator& allocator)
+{
+#if EMILUA_CONFIG_ENABLE_LUA_ALLOCATOR
+    // LuaJIT refuses custom allocators on x86-64 unless built with GC64
+    static std::atomic_bool custom_allocator_supported{true};
+    if (custom_allocator_supported.load(std::memory_order_relaxed)) {
+        lua_State* L = lua_newstate(detail::lua_allocator::alloc, &allocator);
+        if (L) {
+            // luaL_newstate() would install a similar panic function
+            lua_atpanic(L, lua_panic);
+            return L;
+        }
+        custom_allocator_supported.store(false, std::memory_order_relaxed);
+    }
+#endif // EMILUA_CONFIG_ENABLE_LUA_ALLOCATOR
+
+    lua_State* L = luaL_newstate();
+    if (L)
+        allocator.wrap(L);
+    return L;
+}
+
+handler_memory_pool::~handler_memory_pool()
+{
+    for (auto& l : free_lists) {
+        while (l.head) {
+            auto b = l.head;
+            l.head = b->next;
+            ::operator delete(b);
+        }
+    }
+}
+
+// trivially destructible so it's still valid while the thread's other
+// thread_local objects are destroyed
+static thread_local bool handler_memory_pool_destroyed = false;
+
+handler_memory_pool* handler_memory_pool::this_thread() noexcept
+{
+    struct holder
+    {
+        ~holder()
+        {
+            handler_memory_pool_destroyed = true;
+        }
+
+        handler_memory_pool pool;
+    };
+
+    if (handler_memory_pool_destroyed)
+        return nullptr;
+
+    thread_local holder h;
+    return &h.pool;
+}
+
+void* handler_memory_pool::allocate(std::size_t size)
+{
+    if (size > max_block_size)
+        return ::operator new(size);
+
+    auto idx = size_class(size);
+    if (auto pool = this_thread() ; pool) {
+        auto& l = pool->free_lists[idx];
+        if (l.head) {
+            auto b = l.head;
+            l.head = b->next;
+            --l.size;
+            return b;
+        }
+    }
+    // round up so the block can serve any request from the same size class
+    return ::operator new((idx + 1) * granularity);
+}
+
+void handler_memory_pool::deallocate(void* p, std::size_t size) noexcept
+{
+    if (size > max_block_size) {
+        ::operator delete(p);
+        return;
+    }
+
+    if (auto pool = this_thread() ; pool) {
+        auto& l = pool->free_lists[size_class(size)];
+        if (l.size < max_cached_blocks) {
+            l.head = new (p) free_block{l.head};
+            ++l.size;
+            return;
+        }
+    }
+    ::operator delete(p);
+}
+
 vm_context::vm_context(emilua::app_context& appctx, strand_type strand)
     : appctx(appctx)
     , strand_(std::move(strand))
+    , stats_(std::make_shared<vm_scheduler_stats>())
     , valid_(true)
     , lua_errmem(false)
     , exit_request(false)
-    , L_(luaL_newstate())
+    , L_(new_lua_state(allocator_))
     , current_fiber_(nullptr)
 {
     if (!L_)
         throw std::bad_alloc{};
+
+    {
+        std::lock_guard guard{appctx.vms_mtx};
+        appctx.vms.insert(this);
+    }
+
+    ++appctx.nvms;
 }
 
 vm_context::~vm_context()
 {
+    {
+        std::lock_guard guard{appctx.vms_mtx};
+        appctx.vms.erase(this);
+    }
+
     if (valid_)
         close();
+
+    if (core_)
+        --core_->nvms;
+
+    // no VM is left to spawn new ones, so core threads may finish
+    if (--appctx.nvms == 0)
+        appctx.release_core_work_guards();
 }
 
 void vm_context::close()
@@ -235,7 +568,17 @@ void vm_context::close()
         suppress_tail_errors = true;
     }
 
+    if (appctx.profiler) {
+        std::lock_guard guard{appctx.profiler->hook_mtx};
+        for (auto& slot: appctx.profiler->slots) {
+            if (slot->attached == this)
+                slot->attached = nullptr;
+        }
+    }
+
+    allocator_.unwrap(L_);
     lua_close(L_);
+    allocator_.release();
 
     if (!suppress_tail_errors && failed_cleanup_handler_coro) {
         std::string_view red{"\033[31;1m"};
@@ -293,13 +636,9 @@ void vm_context::close()
     valid_ = false;
     L_ = nullptr;
     inbox.recv_fiber = nullptr;
-    inbox.open = false;
     inbox.work_guard.reset();
-
-    for (auto& m: inbox.incoming) {
-        m.wake_on_destruct = true;
-    }
-    inbox.incoming.clear();
+    if (inbox.open)
+        close_inbox();
 
     pending_operations.clear_and_dispose([](pending_operation* op) {
         op->cancel();
@@ -317,6 +656,273 @@ void vm_context::close()
     });
 }
 
+void vm_context::collect_inbox()
+{
+    if (!inbox.open)
+        return;
+
+    auto m = inbox.take_pending();
+    if (!m)
+        return;
+
+    // the queue is a LIFO
+    inbox_t::queued_message* fifo = nullptr;
+    while (m) {
+        auto next = m->next;
+        m->next = fifo;
+        fifo = m;
+        m = next;
+    }
+
+    std::size_t ncollected = 0;
+    while (fifo) {
+        auto next = fifo->next;
+        inbox.incoming.emplace_back(std::move(fifo->sender));
+        inbox.incoming.back().wake_on_destruct = false;
+        delete fifo;
+        fifo = next;
+        ++ncollected;
+    }
+    inbox.npending -= ncollected;
+
+    if (inbox.overflow == inbox_t::overflow_policy::drop_oldest) {
+        auto it = inbox.incoming.begin();
+        while (inbox.nbuffered > inbox.capacity) {
+            it = std::find_if(
+                it, inbox.incoming.end(),
+                [](const inbox_t::sender_state& s) { return s.buffered; });
+            if (it == inbox.incoming.end())
+                break;
+            it = inbox.incoming.erase(it);
+            --inbox.nbuffered;
+        }
+    }
+
+    sync_inbox_backlog();
+}
+
+void vm_context::close_inbox()
+{
+    inbox.open = false;
+    inbox.cancel_recv_timer();
+    for (auto& m: inbox.incoming) {
+        m.wake_on_destruct = true;
+    }
+    inbox.incoming.clear();
+
+    // their senders are still waiting (wake_on_destruct is set)
+    inbox_t::delete_chain(inbox.close_pending());
+
+    sync_inbox_backlog();
+}
+
+static void profiler_hook(lua_State* L, lua_Debug*)
+{
+    auto& vm_ctx = get_vm_context(L);
+    auto& profiler = *vm_ctx.appctx.profiler;
+    {
+        std::lock_guard guard{profiler.hook_mtx};
+        lua_sethook(L, nullptr, 0, 0);
+    }
+
+    // the hook runs on the thread resuming the VM
+    auto& slot = profiler.this_thread();
+
+    // the line is built in the spare capacity of `pending` (no allocations)
+    // and discarded if it doesn't fit
+    auto& out = slot.pending;
+    auto line_start = out.size();
+    bool fits = true;
+    auto append = [&](std::string_view s) {
+        // room for the final '\n' is always kept
+        if (!fits || out.capacity() - out.size() <= s.size()) {
+            fits = false;
+            return;
+        }
+        out.append(s);
+    };
+
+    append(vm_ctx.profiler_label);
+    append((L == vm_ctx.L()) ? ";[main fiber]" : ";[fiber]");
+
+    // root frame first
+    lua_Debug ar;
+    int depth = 0;
+    while (depth < 64 && lua_getstack(L, depth, &ar))
+        ++depth;
+    while (depth-- > 0) {
+        lua_getstack(L, depth, &ar);
+        lua_getinfo(L, "Sn", &ar);
+        append(";");
+        append(ar.short_src);
+        append(":");
+        if (ar.name) {
+            append(ar.name);
+        } else {
+            char buf[16];
+            auto res = std::to_chars(buf, buf + sizeof(buf), ar.linedefined);
+            append(std::string_view(buf, res.ptr - buf));
+        }
+    }
+
+    if (!fits) {
+        out.resize(line_start);
+        ++slot.nlost;
+        return;
+    }
+    out.push_back('\n');
+}
+
+app_context::profiler_state::~profiler_state()
+{
+    stop();
+}
+
+app_context::profiler_state::thread_slot&
+app_context::profiler_state::this_thread()
+{
+    // there is a single app_context per process
+    static thread_local thread_slot* slot = nullptr;
+    if (slot)
+        return *slot;
+
+    auto new_slot = std::make_unique<thread_slot>();
+    // room for a few seconds worth of samples within a single lua_resume()
+    new_slot->pending.reserve(1024 * 1024);
+
+    std::lock_guard guard{hook_mtx};
+    slots.emplace_back(std::move(new_slot));
+    slot = slots.back().get();
+    return *slot;
+}
+
+void app_context::profiler_state::start()
+{
+    sampler = std::thread{[this]() {
+        constexpr auto interval = std::chrono::milliseconds(1);
+        auto next = std::chrono::steady_clock::now();
+        while (!stop_requested) {
+            next += interval;
+            std::this_thread::sleep_until(next);
+
+            // ticks missed while this thread was descheduled are dropped
+            // rather than fired back-to-back
+            auto now = std::chrono::steady_clock::now();
+            if (now - next > interval)
+                next = now;
+
+            std::lock_guard guard{hook_mtx};
+            for (auto& slot: slots) {
+                if (!slot->attached)
+                    continue;
+
+                lua_sethook(slot->attached->L(), profiler_hook, LUA_MASKCOUNT,
+                            /*count=*/1);
+            }
+        }
+    }};
+}
+
+void app_context::profiler_state::stop()
+{
+    if (!sampler.joinable())
+        return;
+
+    stop_requested = true;
+    sampler.join();
+}
+
+void app_context::profiler_state::flush(thread_slot& slot)
+{
+    if (slot.pending.empty() && slot.nlost == 0)
+        return;
+
+    std::lock_guard guard{samples_mtx};
+    std::string_view rest = slot.pending;
+    while (rest.size() > 0) {
+        auto nl = rest.find('\n');
+        ++samples[std::string{rest.substr(0, nl)}];
+        rest.remove_prefix(nl + 1);
+    }
+    slot.pending.clear();
+
+    if (slot.nlost > 0) {
+        samples["[lost samples]"] += slot.nlost;
+        slot.nlost = 0;
+    }
+}
+
+// A tick armed in the VM that was running on this thread but not taken yet
+// moves along to the next one. With no VM running (`to` is null), it's
+// dropped.
+static void move_profiler_hook(app_context::profiler_state& profiler,
+                               app_context::profiler_state::thread_slot& slot,
+                               vm_context* to)
+{
+    std::lock_guard guard{profiler.hook_mtx};
+    auto from = slot.attached;
+    if (from == to)
+        return;
+
+    bool armed = from && lua_gethook(from->L()) != nullptr;
+    if (armed)
+        lua_sethook(from->L(), nullptr, 0, 0);
+    slot.attached = to;
+    if (armed && to)
+        lua_sethook(to->L(), profiler_hook, LUA_MASKCOUNT, /*count=*/1);
+}
+
+vm_context* vm_context::attach_profiler()
+{
+    auto& slot = appctx.profiler->this_thread();
+    auto previous = slot.attached;
+    move_profiler_hook(*appctx.profiler, slot, this);
+    return previous;
+}
+
+void vm_context::detach_profiler(vm_context* previous)
+{
+    auto& slot = appctx.profiler->this_thread();
+    appctx.profiler->flush(slot);
+    move_profiler_hook(*appctx.profiler, slot, previous);
+}
+
+int vm_context::resume(lua_State* fiber, int narg)
+{
+    vm_context* previous_profiled = nullptr;
+    if (appctx.profiler)
+        previous_profiled = attach_profiler();
+
+    if (appctx.tracer && !fiber_data(fiber).trace_async_op.empty())
+        trace_async_op_end(*this, fiber);
+
+    auto start = std::chrono::steady_clock::now();
+    int res = lua_resume(fiber, narg);
+    auto end = std::chrono::steady_clock::now();
+    std::int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        end - start).count();
+
+    if (appctx.profiler)
+        detach_profiler(previous_profiled);
+
+    if (appctx.tracer)
+        trace_fiber_slice(*this, fiber, start, end, res != LUA_YIELD);
+
+    // only this strand writes these counters, so there is no need for atomic
+    // read-modify-write operations
+    auto& stats = *stats_;
+    stats.resumes.store(
+        stats.resumes.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    stats.resume_time_ns.store(
+        stats.resume_time_ns.load(std::memory_order_relaxed) + elapsed,
+        std::memory_order_relaxed);
+    if (elapsed > stats.longest_slice_ns.load(std::memory_order_relaxed))
+        stats.longest_slice_ns.store(elapsed, std::memory_order_relaxed);
+
+    return res;
+}
+
 void vm_context::fiber_epilogue(int resume_result)
 {
     assert(valid_);
@@ -360,13 +966,8 @@ void vm_context::fiber_epilogue(int resume_result)
                 lua_pushnil(current_fiber_);
                 lua_rawset(current_fiber_, LUA_REGISTRYINDEX);
 
-                if (!inbox.imported) {
-                    inbox.open = false;
-                    for (auto& m: inbox.incoming) {
-                        m.wake_on_destruct = true;
-                    }
-                    inbox.incoming.clear();
-                }
+                if (!inbox.imported)
+                    close_inbox();
             }
 
             if (resume_result == LUA_ERRRUN) {
@@ -394,9 +995,8 @@ void vm_context::fiber_epilogue(int resume_result)
                 }
             }
 
-            lua_pushthread(current_fiber_);
-            lua_pushnil(current_fiber_);
-            lua_rawset(current_fiber_, -5);
+            lua_pop(current_fiber_, 3);
+            release_fiber(current_fiber_);
             // TODO (?): force a full GC round on `L()` now
         } else if (joiner_type == LUA_TTHREAD) {
             // Joined
@@ -442,6 +1042,8 @@ void vm_context::fiber_epilogue(int resume_result)
                 }
             }
             if (join_handle) {
+                if (resume_result == 0)
+                    release_fiber(current_fiber_);
                 join_handle->fiber = nullptr;
                 join_handle->interruption_caught = interruption_caught;
             } else {
@@ -450,9 +1052,10 @@ void vm_context::fiber_epilogue(int resume_result)
             }
 
             current_fiber_ = joiner;
+            current_fiber_data_ = &fiber_data(joiner);
             lua_pushnil(joiner);
             set_interrupter(joiner, *this);
-            int res = lua_resume(joiner, nret + 1);
+            int res = resume(joiner, nret + 1);
             // I'm assuming the compiler will eliminate this tail recursive call
             // or else we may experience stack overflow on really really long
             // join()-chains. Still better than the round-trip of post
@@ -593,71 +1196,74 @@ std::string errobj_to_string(std::variant<std::string_view, std::error_code> o)
     );
 }
 
-void set_interrupter(lua_State* L, vm_context& vm_ctx)
+// Stores the value on top of `L`'s stack (and pops it) at
+// FiberDataIndex::INTERRUPTER for the current fiber
+static void set_lua_interrupter(lua_State* L, vm_context& vm_ctx)
 {
     auto current_fiber = vm_ctx.current_fiber();
-    bool interruption_disabled;
 
     rawgetp(L, LUA_REGISTRYINDEX, &fiber_list_key);
     lua_pushthread(current_fiber);
     lua_xmove(current_fiber, L, 1);
     lua_rawget(L, -2);
-    lua_rawgeti(L, -1, FiberDataIndex::INTERRUPTION_DISABLED);
-    switch (lua_type(L, -1)) {
-    case LUA_TBOOLEAN:
-        interruption_disabled = lua_toboolean(L, -1);
-        break;
-    case LUA_TNUMBER:
-        interruption_disabled = lua_tointeger(L, -1) > 0;
-        break;
-    default: assert(false);
+    lua_pushvalue(L, -3);
+    lua_rawseti(L, -2, FiberDataIndex::INTERRUPTER);
+    lua_pop(L, 3);
+}
+
+void set_interrupter(lua_State* L, vm_context& vm_ctx)
+{
+    using interrupter_type = native_fiber_data::interrupter_type;
+
+    // only installing an interrupter announces a suspension. Clearing it
+    // means the operation already completed (or never suspended).
+    if (vm_ctx.appctx.tracer) {
+        if (lua_type(L, -1) != LUA_TNIL) {
+            trace_async_op_begin(vm_ctx);
+        } else if (!vm_ctx.current_fiber_data().trace_async_op.empty()) {
+            trace_async_op_end(vm_ctx, vm_ctx.current_fiber());
+        }
     }
-    if (interruption_disabled) {
-        lua_pop(L, 4);
+
+    auto& fiber_data = vm_ctx.current_fiber_data();
+    if (fiber_data.interruption_disabled()) {
+        lua_pop(L, 1);
+        return;
+    }
+
+    if (lua_type(L, -1) != LUA_TNIL) {
+        fiber_data.interrupter = interrupter_type::lua_function;
+        set_lua_interrupter(L, vm_ctx);
         return;
     }
 
-    lua_pushvalue(L, -4);
-    lua_rawseti(L, -3, FiberDataIndex::INTERRUPTER);
-    lua_pop(L, 4);
+    if (fiber_data.interrupter == interrupter_type::lua_function) {
+        // release the reference so the GC may collect the old interrupter
+        set_lua_interrupter(L, vm_ctx);
+    } else {
+        lua_pop(L, 1);
+    }
+    fiber_data.interrupter = interrupter_type::none;
 }
 
 asio::cancellation_slot
 set_default_interrupter(lua_State* L, vm_context& vm_ctx)
 {
-    auto current_fiber = vm_ctx.current_fiber();
-    bool interruption_disabled;
+    using interrupter_type = native_fiber_data::interrupter_type;
 
-    rawgetp(L, LUA_REGISTRYINDEX, &fiber_list_key);
-    lua_pushthread(current_fiber);
-    lua_xmove(current_fiber, L, 1);
-    lua_rawget(L, -2);
-    lua_rawgeti(L, -1, FiberDataIndex::INTERRUPTION_DISABLED);
-    switch (lua_type(L, -1)) {
-    case LUA_TBOOLEAN:
-        interruption_disabled = lua_toboolean(L, -1);
-        break;
-    case LUA_TNUMBER:
-        interruption_disabled = lua_tointeger(L, -1) > 0;
-        break;
-    default: assert(false);
-    }
-    if (interruption_disabled) {
-        lua_pop(L, 3);
-        return {};
-    }
+    if (vm_ctx.appctx.tracer)
+        trace_async_op_begin(vm_ctx);
 
-    lua_rawgeti(L, -2, FiberDataIndex::ASIO_CANCELLATION_SIGNAL);
-    auto cancel_signal = static_cast<asio::cancellation_signal*>(
-        lua_touserdata(L, -1));
-    lua_rawgeti(L, -3, FiberDataIndex::DEFAULT_EMIT_SIGNAL_INTERRUPTER);
-    lua_rawseti(L, -4, FiberDataIndex::INTERRUPTER);
-    lua_pop(L, 4);
-
-    if (!cancel_signal)
+    auto& fiber_data = vm_ctx.current_fiber_data();
+    if (fiber_data.interruption_disabled())
         return {};
 
-    return cancel_signal->slot();
+    if (fiber_data.interrupter == interrupter_type::lua_function) {
+        lua_pushnil(L);
+        set_lua_interrupter(L, vm_ctx);
+    }
+    fiber_data.interrupter = interrupter_type::cancellation_signal;
+    return fiber_data.cancel_signal.slot();
 }
 
 class lua_category_impl: public std::error_category
@@ -815,53 +1421,26 @@ exception::exception(errc ec, const char* what_arg)
 
 bool detail::unsafe_can_suspend(vm_context& vm_ctx, lua_State* L)
 {
-    auto current_fiber = vm_ctx.current_fiber();
-    rawgetp(L, LUA_REGISTRYINDEX, &fiber_list_key);
-    lua_pushthread(current_fiber);
-    lua_xmove(current_fiber, L, 1);
-    lua_rawget(L, -2);
-    lua_rawgeti(L, -1, FiberDataIndex::SUSPENSION_DISALLOWED);
-    if (lua_tointeger(L, -1) != 0) {
+    auto& fiber_data = vm_ctx.current_fiber_data();
+    if (fiber_data.suspension_disallowed_count != 0) {
         push(L, emilua::errc::forbid_suspend_block);
         return false;
     }
-    lua_rawgeti(L, -2, FiberDataIndex::INTERRUPTION_DISABLED);
-    bool interruption_disabled;
-    switch (lua_type(L, -1)) {
-    case LUA_TBOOLEAN:
-        interruption_disabled = lua_toboolean(L, -1);
-        break;
-    case LUA_TNUMBER:
-        interruption_disabled = lua_tointeger(L, -1) > 0;
-        break;
-    default: assert(false);
-    }
-    if (interruption_disabled) {
-        lua_pop(L, 4);
+    if (fiber_data.interruption_disabled())
         return true;
-    }
-    lua_rawgeti(L, -3, FiberDataIndex::INTERRUPTED);
-    if (lua_toboolean(L, -1) == 1) {
+    if (fiber_data.interrupted) {
         push(L, emilua::errc::interrupted);
         return false;
     }
-    lua_pop(L, 5);
     return true;
 }
 
 bool detail::unsafe_can_suspend2(vm_context& vm_ctx, lua_State* L)
 {
-    auto current_fiber = vm_ctx.current_fiber();
-    rawgetp(L, LUA_REGISTRYINDEX, &fiber_list_key);
-    lua_pushthread(current_fiber);
-    lua_xmove(current_fiber, L, 1);
-    lua_rawget(L, -2);
-    lua_rawgeti(L, -1, FiberDataIndex::SUSPENSION_DISALLOWED);
-    if (lua_tointeger(L, -1) != 0) {
+    if (vm_ctx.current_fiber_data().suspension_disallowed_count != 0) {
         push(L, emilua::errc::forbid_suspend_block);
         return false;
     }
-    lua_pop(L, 3);
     return true;
 }
 
@@ -6,6 +6,7 @@
 #include <emilua/fiber.hpp>
 #include <emilua/dispatch_table.hpp>
 #include <emilua/scope_cleanup.hpp>
+#include <emilua/tracer.hpp>
 
 #include <fmt/ostream.h>
 #include <fmt/format.h>
@@ -27,7 +28,7 @@ char yield_reason_is_native_key;
 static char spawn_start_fn_key;
 static char fiber_mt_key;
 static char fiber_join_key;
-static char asio_cancellation_signal_mt_key;
+static char fiber_pool_key;
 
 static int fiber_join(lua_State* L)
 {
@@ -128,10 +129,7 @@ static int fiber_join(lua_State* L)
                 return lua_yield(L, 0);
             }
             lua_xmove(handle->fiber, L, nret);
-            rawgetp(handle->fiber, LUA_REGISTRYINDEX, &fiber_list_key);
-            lua_pushthread(handle->fiber);
-            lua_pushnil(handle->fiber);
-            lua_rawset(handle->fiber, -3);
+            release_fiber(handle->fiber);
             handle->fiber = nullptr;
             handle->interruption_caught = false;
             // TODO (?): force a full GC round now
@@ -139,10 +137,7 @@ static int fiber_join(lua_State* L)
         }
         case FiberStatus::FINISHED_WITH_ERROR: {
             lua_xmove(handle->fiber, L, 1);
-            rawgetp(handle->fiber, LUA_REGISTRYINDEX, &fiber_list_key);
-            lua_pushthread(handle->fiber);
-            lua_pushnil(handle->fiber);
-            lua_rawset(handle->fiber, -3);
+            release_fiber(handle->fiber);
             handle->fiber = nullptr;
             auto err_obj = inspect_errobj(L);
             if (auto e = std::get_if<std::error_code>(&err_obj) ; e) {
@@ -206,9 +201,8 @@ static int fiber_detach(lua_State* L)
                             errobj_to_string(err_obj), tostringview(L, -1));
             }
         }
-        lua_pushthread(handle->fiber);
-        lua_pushnil(handle->fiber);
-        lua_rawset(handle->fiber, -5);
+        lua_pop(handle->fiber, 3);
+        release_fiber(handle->fiber);
         // TODO (?): force a full GC round on `L()` now
     }
     handle->fiber = nullptr;
@@ -232,24 +226,32 @@ static int fiber_interrupt(lua_State* L)
     if (!handle->fiber)
         return 0;
 
-    rawgetp(handle->fiber, LUA_REGISTRYINDEX, &fiber_list_key);
-    lua_pushthread(handle->fiber);
-    lua_rawget(handle->fiber, -2);
-    lua_replace(handle->fiber, -2);
-    lua_xmove(handle->fiber, L, 1);
-
-    lua_pushboolean(L, 1);
-    lua_rawseti(L, -2, FiberDataIndex::INTERRUPTED);
+    auto& fiber_data = vm_ctx.fiber_data(handle->fiber);
+    fiber_data.interrupted = true;
 
     if (handle->fiber == vm_ctx.current_fiber())
         return 0;
 
-    lua_rawgeti(L, -1, FiberDataIndex::INTERRUPTER);
-    if (lua_type(L, -1) != LUA_TNIL) {
+    switch (fiber_data.interrupter) {
+    case native_fiber_data::interrupter_type::none:
+        break;
+    case native_fiber_data::interrupter_type::cancellation_signal:
+        fiber_data.interrupter = native_fiber_data::interrupter_type::none;
+        fiber_data.cancel_signal.emit(asio::cancellation_type::terminal);
+        break;
+    case native_fiber_data::interrupter_type::lua_function:
+        rawgetp(handle->fiber, LUA_REGISTRYINDEX, &fiber_list_key);
+        lua_pushthread(handle->fiber);
+        lua_rawget(handle->fiber, -2);
+        lua_replace(handle->fiber, -2);
+        lua_xmove(handle->fiber, L, 1);
+
+        lua_rawgeti(L, -1, FiberDataIndex::INTERRUPTER);
         lua_call(L, 0, 0);
 
         lua_pushnil(L);
         lua_rawseti(L, -2, FiberDataIndex::INTERRUPTER);
+        fiber_data.interrupter = native_fiber_data::interrupter_type::none;
     }
 
     return 0;
@@ -357,56 +359,91 @@ static int fiber_mt_gc(lua_State* L)
                             errobj_to_string(err_obj), tostringview(L, -1));
             }
         }
-        lua_pushthread(handle->fiber);
-        lua_pushnil(handle->fiber);
-        lua_rawset(handle->fiber, -5);
+        lua_pop(handle->fiber, 3);
+        release_fiber(handle->fiber);
     }
     handle->fiber = nullptr;
     return 0;
 }
 
+void release_fiber(lua_State* fiber)
+{
+    rawgetp(fiber, LUA_REGISTRYINDEX, &fiber_list_key);
+    lua_pushthread(fiber);
+    lua_rawget(fiber, -2);
+    lua_pushthread(fiber);
+    lua_pushnil(fiber);
+    lua_rawset(fiber, -4);
+
+    // Only fibers created by spawn() that returned normally may run again. In
+    // LuaJIT, a thread that finished without errors is resumable again once a
+    // new function is pushed onto its stack. Modules' fibers (and the main
+    // fiber) carry a STACK entry.
+    lua_rawgeti(fiber, -1, FiberDataIndex::STACK);
+    bool reusable = lua_status(fiber) == 0 && lua_type(fiber, -1) == LUA_TNIL;
+    lua_pop(fiber, 1);
+
+    rawgetp(fiber, LUA_REGISTRYINDEX, &fiber_pool_key);
+    int len = (int)lua_objlen(fiber, -1);
+    if (!reusable || len >= 2 * EMILUA_IMPL_FIBER_POOL_CAPACITY) {
+        lua_pop(fiber, 3);
+        get_vm_context(fiber).erase_fiber_data(fiber);
+        return;
+    }
+
+    // The native fiber data (and its cancellation signal) is kept as well and
+    // spawn() resets it. Everything in the data table would be stale for the
+    // next fiber.
+    for (lua_Integer i = FiberDataIndex::JOINER ;
+         i <= FiberDataIndex::CONTEXT ; ++i) {
+        lua_pushnil(fiber);
+        lua_rawseti(fiber, -3, i);
+    }
+    reset_coro_or_fiber_scope(fiber);
+
+    lua_pushthread(fiber);
+    lua_rawseti(fiber, -2, len + 1);
+    lua_pushvalue(fiber, -2);
+    lua_rawseti(fiber, -2, len + 2);
+    lua_settop(fiber, 0);
+}
+
 static int spawn(lua_State* L)
 {
     luaL_checktype(L, 1, LUA_TFUNCTION);
 
     auto vm_ctx = get_vm_context(L).shared_from_this();
-    auto new_fiber = lua_newthread(L);
-    init_new_coro_or_fiber_scope(new_fiber, L);
-
-    rawgetp(new_fiber, LUA_REGISTRYINDEX, &fiber_list_key);
-    lua_pushthread(new_fiber);
-    lua_createtable(
-        new_fiber,
-        /*narr=*/EMILUA_IMPL_INITIAL_FIBER_DATA_CAPACITY,
-        /*nrec=*/0);
-    {
-        lua_pushinteger(new_fiber, 0);
-        lua_rawseti(new_fiber, -2, FiberDataIndex::INTERRUPTION_DISABLED);
-    }
-    {
-        auto cancel_signal = static_cast<asio::cancellation_signal*>(
-            lua_newuserdata(L, sizeof(asio::cancellation_signal)));
-        rawgetp(L, LUA_REGISTRYINDEX, &asio_cancellation_signal_mt_key);
-        setmetatable(L, -2);
-        new (cancel_signal) asio::cancellation_signal{};
-        lua_pushvalue(L, -1);
+    lua_State* new_fiber;
+
+    rawgetp(L, LUA_REGISTRYINDEX, &fiber_pool_key);
+    if (int len = (int)lua_objlen(L, -1) ; len > 0) {
+        // thread and fiber data table (already reset) were stored by
+        // release_fiber()
+        lua_rawgeti(L, -1, len - 1);
+        lua_rawgeti(L, -2, len);
+        lua_pushnil(L);
+        lua_rawseti(L, -4, len);
+        lua_pushnil(L);
+        lua_rawseti(L, -4, len - 1);
+        new_fiber = lua_tothread(L, -2);
 
-        lua_pushcclosure(
-            L,
-            [](lua_State* L) -> int {
-                auto cancel_signal = static_cast<asio::cancellation_signal*>(
-                    lua_touserdata(L, lua_upvalueindex(1)));
-                assert(cancel_signal);
-                cancel_signal->emit(asio::cancellation_type::terminal);
-                return 0;
-            },
-            1);
+        rawgetp(new_fiber, LUA_REGISTRYINDEX, &fiber_list_key);
+        lua_pushthread(new_fiber);
+        lua_xmove(L, new_fiber, 1);
+    } else {
+        new_fiber = lua_newthread(L);
+        init_new_coro_or_fiber_scope(new_fiber, L);
 
-        lua_xmove(L, new_fiber, 2);
-        lua_rawseti(new_fiber, -3,
-                    FiberDataIndex::DEFAULT_EMIT_SIGNAL_INTERRUPTER);
-        lua_rawseti(new_fiber, -2, FiberDataIndex::ASIO_CANCELLATION_SIGNAL);
+        rawgetp(new_fiber, LUA_REGISTRYINDEX, &fiber_list_key);
+        lua_pushthread(new_fiber);
+        lua_createtable(
+            new_fiber,
+            /*narr=*/EMILUA_IMPL_INITIAL_FIBER_DATA_CAPACITY,
+            /*nrec=*/0);
     }
+    vm_ctx->new_fiber_data(new_fiber);
+    if (vm_ctx->appctx.tracer)
+        trace_fiber_spawn(*vm_ctx, new_fiber);
     {
         rawgetp(L, LUA_REGISTRYINDEX, &fiber_list_key);
         lua_pushthread(vm_ctx->current_fiber());
@@ -459,74 +496,60 @@ static int this_fiber_yield(lua_State* L)
     return lua_yield(L, 0);
 }
 
-inline int increment_this_fiber_counter(lua_State* L, FiberDataIndex counter)
+inline int increment_this_fiber_counter(
+    lua_State* L, lua_Integer native_fiber_data::*counter)
 {
     auto& vmctx = get_vm_context(L);
-    auto current_fiber = vmctx.current_fiber();
 
-    if (current_fiber == vmctx.async_event_thread_)
+    if (vmctx.current_fiber() == vmctx.async_event_thread_)
         return 0;
 
-    rawgetp(L, LUA_REGISTRYINDEX, &fiber_list_key);
-    lua_pushthread(current_fiber);
-    lua_xmove(current_fiber, L, 1);
-    lua_rawget(L, -2);
-    lua_rawgeti(L, -1, counter);
-    auto count = lua_tointeger(L, -1);
+    auto& count = vmctx.current_fiber_data().*counter;
     ++count;
     assert(count >= 0); //< TODO: better overflow detection and VM shutdown
-    lua_pushinteger(L, count);
-    lua_rawseti(L, -3, counter);
     return 0;
 }
 
-inline int decrement_this_fiber_counter(lua_State* L, FiberDataIndex counter,
-                                        errc e)
+inline int decrement_this_fiber_counter(
+    lua_State* L, lua_Integer native_fiber_data::*counter, errc e)
 {
     auto& vmctx = get_vm_context(L);
-    auto current_fiber = vmctx.current_fiber();
 
-    if (current_fiber == vmctx.async_event_thread_)
+    if (vmctx.current_fiber() == vmctx.async_event_thread_)
         return 0;
 
-    rawgetp(L, LUA_REGISTRYINDEX, &fiber_list_key);
-    lua_pushthread(current_fiber);
-    lua_xmove(current_fiber, L, 1);
-    lua_rawget(L, -2);
-    lua_rawgeti(L, -1, counter);
-    auto count = lua_tointeger(L, -1);
+    auto& count = vmctx.current_fiber_data().*counter;
     if (!(count > 0)) {
         push(L, e);
         return lua_error(L);
     }
-    lua_pushinteger(L, --count);
-    lua_rawseti(L, -3, counter);
+    --count;
     return 0;
 }
 
 static int this_fiber_disable_interruption(lua_State* L)
 {
     return increment_this_fiber_counter(
-        L, FiberDataIndex::INTERRUPTION_DISABLED);
+        L, &native_fiber_data::interruption_disabled_count);
 }
 
 static int this_fiber_restore_interruption(lua_State* L)
 {
     return decrement_this_fiber_counter(
-        L, FiberDataIndex::INTERRUPTION_DISABLED,
+        L, &native_fiber_data::interruption_disabled_count,
         errc::interruption_already_allowed);
 }
 
 static int this_fiber_forbid_suspend(lua_State* L)
 {
     return increment_this_fiber_counter(
-        L, FiberDataIndex::SUSPENSION_DISALLOWED);
+        L, &native_fiber_data::suspension_disallowed_count);
 }
 
 static int this_fiber_allow_suspend(lua_State* L)
 {
     return decrement_this_fiber_counter(
-        L, FiberDataIndex::SUSPENSION_DISALLOWED,
+        L, &native_fiber_data::suspension_disallowed_count,
         errc::suspension_already_allowed);
 }
 
@@ -674,14 +697,8 @@ void init_fiber_module(lua_State* L)
     }
     lua_rawset(L, LUA_REGISTRYINDEX);
 
-    lua_pushlightuserdata(L, &asio_cancellation_signal_mt_key);
-    {
-        lua_createtable(L, /*narr=*/0, /*nrec=*/1);
-
-        lua_pushliteral(L, "__gc");
-        lua_pushcfunction(L, finalizer<asio::cancellation_signal>);
-        lua_rawset(L, -3);
-    }
+    lua_pushlightuserdata(L, &fiber_pool_key);
+    lua_newtable(L);
     lua_rawset(L, LUA_REGISTRYINDEX);
 
     {
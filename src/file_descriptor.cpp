@@ -18,6 +18,7 @@
 #if BOOST_OS_LINUX
 #include <sys/capability.h>
 #include <emilua/system.hpp>
+#include <emilua/state.hpp>
 #endif // BOOST_OS_LINUX
 
 namespace emilua {
@@ -111,6 +112,8 @@ static int file_descriptor_cap_get(lua_State* L)
         return lua_error(L);
     }
 
+    init_extra_module(L, extra_module::system);
+
     cap_t caps = cap_get_fd(*handle);
     if (caps == NULL) {
         push(L, std::error_code{errno, std::system_category()});
@@ -2,15 +2,20 @@
 
 #include <sys/capability.h>
 #include <sys/mount.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/prctl.h>
 #include <sys/wait.h>
 
 #include <linux/close_range.h>
 #include <linux/securebits.h>
+#include <fcntl.h>
 #include <grp.h>
 
+#include <algorithm>
 #include <iostream>
 #include <charconv>
+#include <vector>
 
 #include <fmt/ostream.h>
 #include <fmt/format.h>
@@ -42,6 +47,25 @@ static int proc_stdout;
 static int proc_stderr;
 static bool proc_stderr_has_color;
 static bool has_lua_hook;
+static std::uint64_t vm_memory_limit;
+
+// A process clone()d ahead of time to serve a future request with the same
+// options. It stays parked at the beginning of child_main() until the
+// supervisor hands over the request's file descriptors through `handoff`.
+struct zygote
+{
+    linux_container_start_vm_request request;
+    pid_t pid;
+    int pidfd;
+    int handoff;
+};
+
+// supervisor-side
+static std::vector<zygote> zygotes;
+
+// zygote-side
+static int zygote_handoff = -1;
+static linux_container_start_vm_request zygote_request;
 
 struct monotonic_allocator
 {
@@ -228,6 +252,46 @@ static void init_hookstate(lua_State* L)
     lua_setglobal(L, "mode");
 }
 
+inbox_t::mapped_string::~mapped_string()
+{
+    munmap(const_cast<char*>(data), size);
+}
+
+// Maps the memfd carrying a linux_container_message::large_string read-only.
+// The memfd must be sealed so its contents can't change while we read them (the
+// sender isn't trusted). Returns null if the memfd isn't acceptable.
+static std::shared_ptr<const inbox_t::mapped_string> map_large_string(int fd)
+{
+    constexpr int required_seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals == -1 || (seals & required_seals) != required_seals)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        return nullptr;
+
+    // short strings go in strbuf so this is a misbehaving sender
+    if (
+        st.st_size <= 255 ||
+        st.st_size > EMILUA_CONFIG_LINUX_NAMESPACES_MESSAGE_MAX_STRING_SIZE
+    ) {
+        return nullptr;
+    }
+
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+        return nullptr;
+
+    try {
+        return std::make_shared<const inbox_t::mapped_string>(
+            static_cast<const char*>(addr), st.st_size);
+    } catch (...) {
+        munmap(addr, st.st_size);
+        throw;
+    }
+}
+
 void linux_container_inbox_op::do_wait()
 {
     service->sock.async_wait(
@@ -241,6 +305,231 @@ void linux_container_inbox_op::do_wait()
     );
 }
 
+// Parses one datagram received from a linux_container_address and appends it to
+// the inbox. `fds` are the descriptors that came along (the ones taken by the
+// message are replaced by -1). Returns false if the sender is misbehaving.
+static bool enqueue_message(
+    vm_context& vm_ctx, linux_container_message& message, ssize_t nread,
+    std::vector<int>& fds, bool accept_large_strings)
+{
+    if (nread < static_cast<ssize_t>(sizeof(message.members[0]) * 2))
+        return false;
+
+    auto boundsvalid = [&message,&nread](const std::string_view& v) {
+        // No overflow ever happens as it's impossible to overrun our buffer
+        // with its current encoding scheme. The point is to avoid leaking
+        // uninitialized data from our stack. That's the attack we're defending
+        // against.
+        return v.data() + v.size() <= reinterpret_cast<char*>(&message) + nread;
+    };
+
+    auto& queue = vm_ctx.inbox.incoming;
+    queue.emplace_back(std::nullopt);
+
+    if (
+        message.members[0].as_int ==
+        (EXPONENT_MASK | linux_container_message::nil)
+    ) {
+        if (!is_snan(message.members[1].as_int)) {
+            queue.back().msg.emplace<lua_Number>(
+                message.members[1].as_double);
+            return true;
+        }
+
+        switch (message.members[1].as_int & MANTISSA_MASK) {
+        default:
+            queue.pop_back();
+            return false;
+        case linux_container_message::boolean_true:
+            queue.back().msg.emplace<bool>(true);
+            break;
+        case linux_container_message::boolean_false:
+            queue.back().msg.emplace<bool>(false);
+            break;
+        case linux_container_message::string: {
+            std::string_view v(reinterpret_cast<char*>(message.strbuf) + 1,
+                               *message.strbuf);
+            if (!boundsvalid(v)) {
+                queue.pop_back();
+                return false;
+            }
+            queue.back().msg.emplace<std::string>(v);
+            break;
+        }
+        case linux_container_message::file_descriptor: {
+            if (fds.size() != 1) {
+                queue.pop_back();
+                return false;
+            }
+
+            queue.back().msg.emplace<
+                std::shared_ptr<inbox_t::file_descriptor_box>
+            >(std::make_shared<inbox_t::file_descriptor_box>(fds[0]));
+            fds[0] = -1;
+            break;
+        }
+        case linux_container_message::large_string: {
+            if (!accept_large_strings || fds.size() != 1) {
+                queue.pop_back();
+                return false;
+            }
+
+            auto v = map_large_string(fds[0]);
+            if (!v) {
+                queue.pop_back();
+                return false;
+            }
+            queue.back().msg.emplace<
+                std::shared_ptr<const inbox_t::mapped_string>>(std::move(v));
+            break;
+        }
+        case linux_container_message::actor_address:
+            if (fds.size() != 1) {
+                queue.pop_back();
+                return false;
+            }
+
+            queue.back().msg.emplace<inbox_t::linux_container_address>(
+                std::make_shared<inbox_t::file_descriptor_box>(fds[0]));
+            fds[0] = -1;
+            break;
+        }
+        return true;
+    }
+
+    if (nread < static_cast<ssize_t>(sizeof(message.members))) {
+        queue.pop_back();
+        return false;
+    }
+
+    auto nextstr = [strit=message.strbuf]() mutable {
+        std::string_view::size_type size = *strit++;
+        std::string_view ret(reinterpret_cast<char*>(strit), size);
+        strit += size;
+        return ret;
+    };
+    auto& dict = queue.back().msg.emplace<
+        std::map<std::string, inbox_t::value_type>>();
+
+    std::vector<int>::size_type fdsidx = 0;
+    for (
+        int nf = 0 ;
+        nf != EMILUA_CONFIG_LINUX_NAMESPACES_MESSAGE_MAX_MEMBERS_NUMBER ;
+        ++nf
+    ) {
+        if (
+            message.members[nf].as_int ==
+            (EXPONENT_MASK | linux_container_message::nil)
+        ) {
+            assert(nf > 0);
+            break;
+        }
+
+        auto key = nextstr();
+        if (!boundsvalid(key)) {
+            queue.pop_back();
+            return false;
+        }
+
+        if (!is_snan(message.members[nf].as_int)) {
+            dict.emplace(key, lua_Number(message.members[nf].as_double));
+            continue;
+        }
+
+        switch (message.members[nf].as_int & MANTISSA_MASK) {
+        default:
+            queue.pop_back();
+            return false;
+        case linux_container_message::boolean_true:
+            dict.emplace(key, true);
+            break;
+        case linux_container_message::boolean_false:
+            dict.emplace(key, false);
+            break;
+        case linux_container_message::string: {
+            auto value = nextstr();
+            if (!boundsvalid(value)) {
+                queue.pop_back();
+                return false;
+            }
+            dict.emplace(key, static_cast<std::string>(value));
+            break;
+        }
+        case linux_container_message::file_descriptor:
+            if (fdsidx == fds.size()) {
+                queue.pop_back();
+                return false;
+            }
+
+            dict.emplace(
+                key,
+                std::make_shared<inbox_t::file_descriptor_box>(
+                    fds[fdsidx]));
+            fds[fdsidx++] = -1;
+            break;
+        case linux_container_message::large_string: {
+            if (!accept_large_strings || fdsidx == fds.size()) {
+                queue.pop_back();
+                return false;
+            }
+
+            auto value = map_large_string(fds[fdsidx++]);
+            if (!value) {
+                queue.pop_back();
+                return false;
+            }
+            dict.emplace(key, std::move(value));
+            break;
+        }
+        case linux_container_message::actor_address:
+            if (fdsidx == fds.size()) {
+                queue.pop_back();
+                return false;
+            }
+
+            dict.emplace(
+                key,
+                inbox_t::linux_container_address{
+                    std::make_shared<inbox_t::file_descriptor_box>(
+                        fds[fdsidx])});
+            fds[fdsidx++] = -1;
+            break;
+        }
+    }
+    return true;
+}
+
+// Datagrams read by a single recvmmsg() call. It's only used while a wake-up is
+// handled so there's one per thread instead of one per sender.
+struct inbox_receive_batch
+{
+    static constexpr unsigned int max_size = 16;
+
+    void reset()
+    {
+        std::memset(headers, 0, sizeof(headers));
+        for (unsigned int i = 0 ; i != max_size ; ++i) {
+            iovs[i].iov_base = &messages[i];
+            iovs[i].iov_len = sizeof(messages[i]);
+            headers[i].msg_hdr.msg_iov = &iovs[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+            headers[i].msg_hdr.msg_control = cmsgs[i].buf;
+            headers[i].msg_hdr.msg_controllen = sizeof(cmsgs[i].buf);
+        }
+    }
+
+    linux_container_message messages[max_size];
+    struct mmsghdr headers[max_size];
+    struct iovec iovs[max_size];
+    union
+    {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(
+            sizeof(int) *
+            EMILUA_CONFIG_LINUX_NAMESPACES_MESSAGE_MAX_MEMBERS_NUMBER)];
+    } cmsgs[max_size];
+};
+
 void linux_container_inbox_op::on_wait(const boost::system::error_code& ec)
 {
     auto vm_ctx = this->vm_ctx.lock();
@@ -256,45 +545,39 @@ void linux_container_inbox_op::on_wait(const boost::system::error_code& ec)
     }
 
     auto recv_fiber = vm_ctx->inbox.recv_fiber;
+    auto resume_no_senders = [&]() {
+        if (vm_ctx->inbox.nsenders != 0 || !recv_fiber)
+            return;
+
+        vm_ctx->inbox.recv_fiber = nullptr;
+        vm_ctx->inbox.cancel_recv_timer();
+        vm_ctx->inbox.work_guard.reset();
+        vm_ctx->fiber_resume(
+            recv_fiber,
+            hana::make_set(
+                hana::make_pair(
+                    vm_context::options::arguments,
+                    hana::make_tuple(errc::no_senders))));
+    };
+
     if (ec) {
         vm_ctx->pending_operations.erase(
             vm_ctx->pending_operations.iterator_to(*service));
         delete service;
-        if (--vm_ctx->inbox.nsenders == 0 && recv_fiber) {
-            vm_ctx->inbox.recv_fiber = nullptr;
-            vm_ctx->inbox.work_guard.reset();
-            vm_ctx->fiber_resume(
-                recv_fiber,
-                hana::make_set(
-                    hana::make_pair(
-                        vm_context::options::arguments,
-                        hana::make_tuple(errc::no_senders))));
-        }
+        --vm_ctx->inbox.nsenders;
+        resume_no_senders();
         return;
     }
 
-    struct msghdr msg;
-    std::memset(&msg, 0, sizeof(msg));
-
-    struct iovec iov;
-    linux_container_message message;
-    iov.iov_base = &message;
-    iov.iov_len = sizeof(message);
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
-
-    union
-    {
-        struct cmsghdr align;
-        char buf[CMSG_SPACE(
-            sizeof(int) *
-            EMILUA_CONFIG_LINUX_NAMESPACES_MESSAGE_MAX_MEMBERS_NUMBER)];
-    } cmsgu;
-    msg.msg_control = cmsgu.buf;
-    msg.msg_controllen = sizeof(cmsgu.buf);
+    thread_local std::unique_ptr<inbox_receive_batch> batch;
+    if (!batch)
+        batch = std::make_unique<inbox_receive_batch>();
+    batch->reset();
 
-    auto nread = recvmsg(service->sock.native_handle(), &msg, MSG_DONTWAIT);
-    if (nread == -1) {
+    int nmsgs = recvmmsg(service->sock.native_handle(), batch->headers,
+                         inbox_receive_batch::max_size, MSG_DONTWAIT,
+                         /*timeout=*/nullptr);
+    if (nmsgs == -1) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
             do_wait();
             return;
@@ -303,437 +586,212 @@ void linux_container_inbox_op::on_wait(const boost::system::error_code& ec)
         vm_ctx->pending_operations.erase(
             vm_ctx->pending_operations.iterator_to(*service));
         delete service;
-        if (--vm_ctx->inbox.nsenders == 0 && recv_fiber) {
-            vm_ctx->inbox.recv_fiber = nullptr;
-            vm_ctx->inbox.work_guard.reset();
-            vm_ctx->fiber_resume(
-                recv_fiber,
-                hana::make_set(
-                    hana::make_pair(
-                        vm_context::options::arguments,
-                        hana::make_tuple(errc::no_senders))));
-        }
+        --vm_ctx->inbox.nsenders;
+        resume_no_senders();
         return;
     }
 
+    // keep messages from local senders that arrived earlier in order
+    vm_ctx->collect_inbox();
+
+    bool sender_gone = false;
     std::vector<int> fds;
     fds.reserve(EMILUA_CONFIG_LINUX_NAMESPACES_MESSAGE_MAX_MEMBERS_NUMBER);
-    BOOST_SCOPE_EXIT_ALL(&) {
-        for (auto& fd: fds) {
-            if (fd != -1) {
-                int res = close(fd);
-                boost::ignore_unused(res);
+    for (int i = 0 ; i != nmsgs ; ++i) {
+        auto& msg = batch->headers[i].msg_hdr;
+
+        fds.clear();
+        BOOST_SCOPE_EXIT_ALL(&) {
+            for (auto& fd: fds) {
+                if (fd != -1) {
+                    int res = close(fd);
+                    boost::ignore_unused(res);
+                }
+            }
+        };
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg) ; cmsg != NULL ;
+             cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (
+                cmsg->cmsg_level != SOL_SOCKET ||
+                cmsg->cmsg_type != SCM_RIGHTS
+            ) {
+                continue;
             }
-        }
-    };
-    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg) ; cmsg != NULL ;
-         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
-            continue;
-        }
 
-        char* in = (char*)CMSG_DATA(cmsg);
-        auto nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
-        for (std::size_t i = 0 ; i != nfds ; ++i) {
-            int fd;
-            std::memcpy(&fd, in, sizeof(int));
-            in += sizeof(int);
-            if (fd != -1)
-                fds.emplace_back(fd);
+            char* in = (char*)CMSG_DATA(cmsg);
+            auto nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (std::size_t j = 0 ; j != nfds ; ++j) {
+                int fd;
+                std::memcpy(&fd, in, sizeof(int));
+                in += sizeof(int);
+                if (fd != -1)
+                    fds.emplace_back(fd);
+            }
         }
-    }
 
-    if (
-        nread < static_cast<ssize_t>(sizeof(message.members[0]) * 2) ||
-        (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))
-    ) {
-        vm_ctx->pending_operations.erase(
-            vm_ctx->pending_operations.iterator_to(*service));
-        delete service;
-        if (--vm_ctx->inbox.nsenders == 0 && recv_fiber) {
-            vm_ctx->inbox.recv_fiber = nullptr;
-            vm_ctx->inbox.work_guard.reset();
-            vm_ctx->fiber_resume(
-                recv_fiber,
-                hana::make_set(
-                    hana::make_pair(
-                        vm_context::options::arguments,
-                        hana::make_tuple(errc::no_senders))));
-        }
-        return;
-    }
-    service->running = false;
+        // Descriptors from the rest of the batch still have to be closed
+        if (sender_gone)
+            continue;
 
-    auto remove_service = [&]() {
-        // Ideally we wouldn't close the channel because the assumption is that
-        // many writers have this handle and only one is misbehaving. Closing
-        // the channel would cut our communication channel with the legitimate
-        // parties which really means DoS.
+        // Ideally we wouldn't close the channel on bad messages because the
+        // assumption is that many writers have this handle and only one is
+        // misbehaving. Closing the channel would cut our communication channel
+        // with the legitimate parties which really means DoS.
         //
         // Unfortunately a misbehaving writer can just send a 0-sized payload
         // and trick us that EOF was reached anyway. Therefore keeping the
         // connection open just to defend against such DoS attacker would be
         // moot. Let's go ahead and just close the socket already.
-        vm_ctx->pending_operations.erase(
-            vm_ctx->pending_operations.iterator_to(*service));
-        delete service;
-        --vm_ctx->inbox.nsenders;
-    };
-
-    auto boundsvalid = [&message,&nread](const std::string_view& v) {
-        // No overflow ever happens as it's impossible to overrun our buffer
-        // with its current encoding scheme. The point is to avoid leaking
-        // uninitialized data from our stack. That's the attack we're defending
-        // against.
-        return v.data() + v.size() <= reinterpret_cast<char*>(&message) + nread;
-    };
-
-    if (!recv_fiber) {
-        auto& queue = vm_ctx->inbox.incoming;
-        queue.emplace_back(std::nullopt);
-
         if (
-            message.members[0].as_int ==
-            (EXPONENT_MASK | linux_container_message::nil)
+            (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) ||
+            !enqueue_message(*vm_ctx, batch->messages[i],
+                             batch->headers[i].msg_len, fds,
+                             service->accept_large_strings)
         ) {
-            if (!is_snan(message.members[1].as_int)) {
-                queue.back().msg.emplace<lua_Number>(
-                    message.members[1].as_double);
-                return;
-            }
-
-            switch (message.members[1].as_int & MANTISSA_MASK) {
-            default:
-                remove_service();
-                queue.pop_back();
-                return;
-            case linux_container_message::boolean_true:
-                queue.back().msg.emplace<bool>(true);
-                break;
-            case linux_container_message::boolean_false:
-                queue.back().msg.emplace<bool>(false);
-                break;
-            case linux_container_message::string: {
-                std::string_view v(reinterpret_cast<char*>(message.strbuf) + 1,
-                                   *message.strbuf);
-                if (!boundsvalid(v)) {
-                    remove_service();
-                    queue.pop_back();
-                    return;
-                }
-                queue.back().msg.emplace<std::string>(v);
-                break;
-            }
-            case linux_container_message::file_descriptor: {
-                if (fds.size() != 1) {
-                    remove_service();
-                    queue.pop_back();
-                    return;
-                }
-
-                queue.back().msg.emplace<
-                    std::shared_ptr<inbox_t::file_descriptor_box>
-                >(std::make_shared<inbox_t::file_descriptor_box>(fds[0]));
-                fds[0] = -1;
-                break;
-            }
-            case linux_container_message::actor_address:
-                if (fds.size() != 1) {
-                    remove_service();
-                    queue.pop_back();
-                    return;
-                }
-
-                queue.back().msg.emplace<inbox_t::linux_container_address>(
-                    std::make_shared<inbox_t::file_descriptor_box>(fds[0]));
-                fds[0] = -1;
-                break;
-            }
-            return;
+            sender_gone = true;
         }
+    }
 
-        if (nread < static_cast<ssize_t>(sizeof(message.members))) {
-            remove_service();
-            queue.pop_back();
-            return;
-        }
-
-        auto nextstr = [strit=message.strbuf]() mutable {
-            std::string_view::size_type size = *strit++;
-            std::string_view ret(reinterpret_cast<char*>(strit), size);
-            strit += size;
-            return ret;
-        };
-        auto& dict = queue.back().msg.emplace<
-            std::map<std::string, inbox_t::value_type>>();
-
-        decltype(fds)::size_type fdsidx = 0;
-        for (
-            int nf = 0 ;
-            nf != EMILUA_CONFIG_LINUX_NAMESPACES_MESSAGE_MAX_MEMBERS_NUMBER ;
-            ++nf
-        ) {
-            if (
-                message.members[nf].as_int ==
-                (EXPONENT_MASK | linux_container_message::nil)
-            ) {
-                assert(nf > 0);
-                break;
-            }
-
-            auto key = nextstr();
-            if (!boundsvalid(key)) {
-                remove_service();
-                queue.pop_back();
-                return;
-            }
-
-            if (!is_snan(message.members[nf].as_int)) {
-                dict.emplace(key, lua_Number(message.members[nf].as_double));
-                continue;
-            }
-
-            switch (message.members[nf].as_int & MANTISSA_MASK) {
-            default:
-                remove_service();
-                queue.pop_back();
-                return;
-            case linux_container_message::boolean_true:
-                dict.emplace(key, true);
-                break;
-            case linux_container_message::boolean_false:
-                dict.emplace(key, false);
-                break;
-            case linux_container_message::string: {
-                auto value = nextstr();
-                if (!boundsvalid(value)) {
-                    remove_service();
-                    queue.pop_back();
-                    return;
-                }
-                dict.emplace(key, static_cast<std::string>(value));
-                break;
-            }
-            case linux_container_message::file_descriptor:
-                if (fdsidx == fds.size()) {
-                    remove_service();
-                    queue.pop_back();
-                    return;
-                }
+    if (sender_gone) {
+        vm_ctx->pending_operations.erase(
+            vm_ctx->pending_operations.iterator_to(*service));
+        delete service;
+        --vm_ctx->inbox.nsenders;
+    } else {
+        service->running = false;
+    }
 
-                dict.emplace(
-                    key,
-                    std::make_shared<inbox_t::file_descriptor_box>(
-                        fds[fdsidx]));
-                fds[fdsidx++] = -1;
-                break;
-            case linux_container_message::actor_address:
-                if (fdsidx == fds.size()) {
-                    remove_service();
-                    queue.pop_back();
-                    return;
-                }
+    if (!recv_fiber)
+        return;
 
-                dict.emplace(
-                    key,
-                    inbox_t::linux_container_address{
-                        std::make_shared<inbox_t::file_descriptor_box>(
-                            fds[fdsidx])});
-                fds[fdsidx++] = -1;
-                break;
-            }
-        }
+    // The whole batch is in the inbox by now. The parked fiber gets the oldest
+    // message and the next receive() calls won't need to suspend.
+    if (vm_ctx->inbox.incoming.size() != 0) {
+        deliver_queued_message(*vm_ctx);
         return;
     }
 
-    struct bad_message_t {};
-
-    auto checkbounds = [&boundsvalid](const std::string_view& v) {
-        if (!boundsvalid(v)) {
-            throw bad_message_t{};
-        }
-    };
+    if (!sender_gone) {
+        service->async_enqueue(*vm_ctx);
+        return;
+    }
 
-    auto deserializer = [&message,&checkbounds,&fds,nread,this](
-        lua_State* recv_fiber
-    ) {
-        if (
-            message.members[0].as_int ==
-            (EXPONENT_MASK | linux_container_message::nil)
-        ) {
-            if (!is_snan(message.members[1].as_int)) {
-                lua_pushnumber(recv_fiber, message.members[1].as_double);
-                return;
-            }
+    resume_no_senders();
+}
 
-            switch (message.members[1].as_int & MANTISSA_MASK) {
-            default:
-                throw bad_message_t{};
-            case linux_container_message::boolean_true:
-                lua_pushboolean(recv_fiber, 1);
-                break;
-            case linux_container_message::boolean_false:
-                lua_pushboolean(recv_fiber, 0);
-                break;
-            case linux_container_message::string: {
-                std::string_view v(reinterpret_cast<char*>(message.strbuf) + 1,
-                                   *message.strbuf);
-                checkbounds(v);
-                push(recv_fiber, v);
-                break;
-            }
-            case linux_container_message::file_descriptor: {
-                if (fds.size() != 1) {
-                    throw bad_message_t{};
-                }
+// Sets the globals read by child_main() from the options in `request` and the
+// file descriptors that came along (the inbox followed by the pipes)
+static void apply_request(
+    const linux_container_start_vm_request& request, const int fds[4])
+{
+    inboxfd = fds[0];
+    assert(inboxfd != -1);
+    int next = 1;
 
-                auto fdhandle = static_cast<file_descriptor_handle*>(
-                    lua_newuserdata(recv_fiber, sizeof(file_descriptor_handle))
-                );
-                rawgetp(recv_fiber, LUA_REGISTRYINDEX, &file_descriptor_mt_key);
-                setmetatable(recv_fiber, -2);
-                *fdhandle = fds[0];
-                fds[0] = -1;
-                break;
-            }
-            case linux_container_message::actor_address:
-                if (fds.size() != 1) {
-                    throw bad_message_t{};
-                }
+    switch (request.stdin_action) {
+    case linux_container_start_vm_request::CLOSE_FD:
+        proc_stdin = -1;
+        break;
+    case linux_container_start_vm_request::SHARE_PARENT:
+        proc_stdin = STDIN_FILENO;
+        break;
+    case linux_container_start_vm_request::USE_PIPE:
+        proc_stdin = fds[next++];
+        assert(proc_stdin != -1);
+        break;
+    }
 
-                auto ch = static_cast<linux_container_address*>(
-                    lua_newuserdata(recv_fiber, sizeof(linux_container_address))
-                );
-                rawgetp(recv_fiber, LUA_REGISTRYINDEX,
-                        &linux_container_chan_mt_key);
-                setmetatable(recv_fiber, -2);
-                new (ch) linux_container_address{executor.context()};
-                {
-                    asio::local::datagram_protocol protocol;
-                    boost::system::error_code ignored_ec;
-                    ch->dest.assign(protocol, fds[0], ignored_ec);
-                    assert(!ignored_ec);
-                    fds[0] = -1;
-                }
-                break;
-            }
-            return;
-        }
+    switch (request.stdout_action) {
+    case linux_container_start_vm_request::CLOSE_FD:
+        proc_stdout = -1;
+        break;
+    case linux_container_start_vm_request::SHARE_PARENT:
+        proc_stdout = STDOUT_FILENO;
+        break;
+    case linux_container_start_vm_request::USE_PIPE:
+        proc_stdout = fds[next++];
+        assert(proc_stdout != -1);
+        break;
+    }
 
-        if (nread < static_cast<ssize_t>(sizeof(message.members))) {
-            throw bad_message_t{};
-        }
+    switch (request.stderr_action) {
+    case linux_container_start_vm_request::CLOSE_FD:
+        proc_stderr = -1;
+        break;
+    case linux_container_start_vm_request::SHARE_PARENT:
+        proc_stderr = STDERR_FILENO;
+        proc_stderr_has_color = request.stderr_has_color;
+        break;
+    case linux_container_start_vm_request::USE_PIPE:
+        proc_stderr = fds[next++];
+        assert(proc_stderr != -1);
+        break;
+    }
+    assert(next == 4 || fds[next] == -1);
 
-        auto nextstr = [strit=message.strbuf,&checkbounds]() mutable {
-            std::string_view::size_type size = *strit++;
-            std::string_view ret(reinterpret_cast<char*>(strit), size);
-            strit += size;
-            checkbounds(ret);
-            return ret;
-        };
-        lua_newtable(recv_fiber);
+    has_lua_hook = request.has_lua_hook;
+    vm_memory_limit = request.memory_limit;
+}
 
-        decltype(fds)::size_type fdsidx = 0;
-        for (
-            int nf = 0 ;
-            nf != EMILUA_CONFIG_LINUX_NAMESPACES_MESSAGE_MAX_MEMBERS_NUMBER ;
-            ++nf
-        ) {
-            if (
-                message.members[nf].as_int ==
-                (EXPONENT_MASK | linux_container_message::nil)
-            ) {
-                assert(nf > 0);
-                break;
-            }
+// Runs in a zygote. Blocks until the supervisor hands over the file descriptors
+// of the request this process will serve.
+static bool wait_for_handoff()
+{
+    // Don't outlive the supervisor and don't keep its other resources (e.g. the
+    // handoff sockets of other zygotes) alive while parked.
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (
+        (zygote_handoff > 3 &&
+         close_range(3, zygote_handoff - 1, /*flags=*/0) == -1) ||
+        close_range(zygote_handoff + 1, UINT_MAX, /*flags=*/0) == -1
+    ) {
+        return false;
+    }
 
-            auto key = nextstr();
-            push(recv_fiber, key);
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
 
-            if (!is_snan(message.members[nf].as_int)) {
-                lua_pushnumber(recv_fiber, message.members[nf].as_double);
-                lua_rawset(recv_fiber, -3);
-                continue;
-            }
+    char ignored_byte;
+    struct iovec iov;
+    iov.iov_base = &ignored_byte;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
 
-            switch (message.members[nf].as_int & MANTISSA_MASK) {
-            default:
-                throw bad_message_t{};
-            case linux_container_message::boolean_true:
-                lua_pushboolean(recv_fiber, 1);
-                break;
-            case linux_container_message::boolean_false:
-                lua_pushboolean(recv_fiber, 0);
-                break;
-            case linux_container_message::string:
-                push(recv_fiber, nextstr());
-                break;
-            case linux_container_message::file_descriptor: {
-                if (fdsidx == fds.size()) {
-                    throw bad_message_t{};
-                }
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * 4)];
+    } cmsgu;
+    msg.msg_control = cmsgu.buf;
+    msg.msg_controllen = sizeof(cmsgu.buf);
 
-                auto fdhandle = static_cast<file_descriptor_handle*>(
-                    lua_newuserdata(recv_fiber, sizeof(file_descriptor_handle))
-                );
-                rawgetp(recv_fiber, LUA_REGISTRYINDEX, &file_descriptor_mt_key);
-                setmetatable(recv_fiber, -2);
-                *fdhandle = fds[fdsidx];
-                fds[fdsidx++] = -1;
-                break;
-            }
-            case linux_container_message::actor_address:
-                if (fdsidx == fds.size()) {
-                    throw bad_message_t{};
-                }
+    auto nread = recvmsg(zygote_handoff, &msg, /*flags=*/0);
+    close(zygote_handoff);
+    if (nread == -1 || nread == 0 || (msg.msg_flags & MSG_CTRUNC))
+        return false;
 
-                auto ch = static_cast<linux_container_address*>(
-                    lua_newuserdata(recv_fiber, sizeof(linux_container_address))
-                );
-                rawgetp(recv_fiber, LUA_REGISTRYINDEX,
-                        &linux_container_chan_mt_key);
-                setmetatable(recv_fiber, -2);
-                new (ch) linux_container_address{executor.context()};
-                {
-                    asio::local::datagram_protocol protocol;
-                    boost::system::error_code ignored_ec;
-                    ch->dest.assign(protocol, fds[fdsidx], ignored_ec);
-                    assert(!ignored_ec);
-                    fds[fdsidx++] = -1;
-                }
-                break;
-            }
-            lua_rawset(recv_fiber, -3);
-        }
-    };
+    int fds[4] = {-1, -1, -1, -1};
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg) ; cmsg != NULL ;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
 
-    vm_ctx->inbox.recv_fiber = nullptr;
-    vm_ctx->inbox.work_guard.reset();
-    try {
-        vm_ctx->fiber_resume(
-            recv_fiber,
-            hana::make_set(
-                hana::make_pair(
-                    vm_context::options::arguments,
-                    hana::make_tuple(std::nullopt, deserializer))));
-    } catch (const bad_message_t&) {
-        remove_service();
-        if (vm_ctx->inbox.nsenders == 0) {
-            vm_ctx->fiber_resume(
-                recv_fiber,
-                hana::make_set(
-                    hana::make_pair(
-                        vm_context::options::arguments,
-                        hana::make_tuple(errc::no_senders))));
-        } else {
-            vm_ctx->inbox.recv_fiber = recv_fiber;
-            vm_ctx->inbox.work_guard = vm_ctx;
-        }
+        assert(sizeof(fds) >= cmsg->cmsg_len - CMSG_LEN(0));
+        std::memcpy(fds, CMSG_DATA(cmsg), cmsg->cmsg_len - CMSG_LEN(0));
+        break;
     }
+    if (fds[0] == -1)
+        return false;
+
+    apply_request(zygote_request, fds);
+    return true;
 }
 
 static int child_main(void*)
 {
+    if (zygote_handoff != -1 && !wait_for_handoff())
+        return 1;
+
     switch (proc_stdin) {
     case -1: {
         int pipefd[2];
@@ -1110,9 +1168,15 @@ static int child_main(void*)
         auto vm_ctx = make_vm(ioctx, appctx, entry_point, ContextType::worker);
         appctx.master_vm = vm_ctx;
 
+        if (vm_memory_limit != 0) {
+            if (vm_ctx->memory_usage() > vm_memory_limit)
+                throw std::bad_alloc{};
+            vm_ctx->memory_limit(vm_memory_limit);
+        }
+
         ++vm_ctx->inbox.nsenders;
         auto inbox_service = new linux_container_inbox_service{
-            ioctx, inboxfd};
+            ioctx, inboxfd, /*accept_large_strings=*/true};
         vm_ctx->pending_operations.push_back(*inbox_service);
 
         vm_ctx->strand().post([vm_ctx]() {
@@ -1139,6 +1203,112 @@ static int child_main(void*)
     return appctx.exit_code;
 }
 
+static bool same_options(const linux_container_start_vm_request& a,
+                         const linux_container_start_vm_request& b)
+{
+    return a.clone_flags == b.clone_flags &&
+        a.stdin_action == b.stdin_action &&
+        a.stdout_action == b.stdout_action &&
+        a.stderr_action == b.stderr_action &&
+        a.stderr_has_color == b.stderr_has_color &&
+        a.has_lua_hook == b.has_lua_hook &&
+        a.memory_limit == b.memory_limit;
+}
+
+// Hands the request's file descriptors over to a zygote started for the same
+// options (if there's one). Returns its pid (and `pidfd`) or -1.
+static pid_t take_zygote(const linux_container_start_vm_request& request,
+                         const int fds[4], int& pidfd)
+{
+    int nfds = 0;
+    while (nfds != 4 && fds[nfds] != -1)
+        ++nfds;
+
+    for (auto it = zygotes.begin() ; it != zygotes.end() ;) {
+        if (!same_options(it->request, request)) {
+            ++it;
+            continue;
+        }
+
+        auto z = *it;
+        it = zygotes.erase(it);
+
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+
+        char ignored_byte = 0;
+        struct iovec iov;
+        iov.iov_base = &ignored_byte;
+        iov.iov_len = 1;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+
+        union {
+            struct cmsghdr align;
+            char buf[CMSG_SPACE(sizeof(int) * 4)];
+        } cmsgu;
+        msg.msg_control = cmsgu.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        std::memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+
+        auto nwritten = sendmsg(z.handoff, &msg, MSG_NOSIGNAL);
+        close(z.handoff);
+        if (nwritten == -1) {
+            // the zygote is gone (e.g. killed by the OOM killer)
+            close(z.pidfd);
+            continue;
+        }
+
+        pidfd = z.pidfd;
+        return z.pid;
+    }
+    return -1;
+}
+
+// Tops up the zygotes for the options in `request` (see
+// linux_container_start_vm_request::nzygotes)
+static void spawn_zygotes(const linux_container_start_vm_request& request)
+{
+    auto nzygotes = std::count_if(
+        zygotes.begin(), zygotes.end(),
+        [&request](const zygote& z) { return same_options(z.request, request); });
+
+    for (; nzygotes < request.nzygotes ; ++nzygotes) {
+        int handoff[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, handoff) == -1)
+            return;
+
+        zygote_handoff = handoff[1];
+        zygote_request = request;
+        int pidfd = -1;
+        pid_t pid = clone(child_main, clone_stack_address, request.clone_flags,
+                          /*arg=*/nullptr, &pidfd);
+        zygote_handoff = -1;
+        close(handoff[1]);
+
+        if (pid == -1) {
+            close(handoff[0]);
+            return;
+        }
+
+        zygotes.push_back(zygote{request, pid, pidfd, handoff[0]});
+    }
+}
+
+// Parked zygotes exit once they see their handoff socket closed
+static void discard_zygotes()
+{
+    for (auto& z : zygotes) {
+        close(z.handoff);
+        close(z.pidfd);
+    }
+    zygotes.clear();
+}
+
 int app_context::linux_namespaces_service_main(int sockfd)
 {
     for (;;) {
@@ -1212,10 +1382,12 @@ int app_context::linux_namespaces_service_main(int sockfd)
         case -1:
             perror("<3>linux_namespaces/supervisor");
             close(sockfd);
+            discard_zygotes();
             while (wait(NULL) > 0);
             return 1;
         case 0:
             close(sockfd);
+            discard_zygotes();
             while (wait(NULL) > 0);
             return 0;
         }
@@ -1240,77 +1412,18 @@ int app_context::linux_namespaces_service_main(int sockfd)
             }
             continue;
         }
-        inboxfd = fds[0];
-        assert(inboxfd != -1);
-
-        switch (request.stdin_action) {
-        case linux_container_start_vm_request::CLOSE_FD:
-            proc_stdin = -1;
-            break;
-        case linux_container_start_vm_request::SHARE_PARENT:
-            proc_stdin = STDIN_FILENO;
-            break;
-        case linux_container_start_vm_request::USE_PIPE:
-            for (int i = 1 ; i != 4 ; ++i) {
-                if (fds[i] != -1) {
-                    proc_stdin = fds[i];
-                    fds[i] = -1;
-                    break;
-                }
-            }
-            assert(proc_stdin != -1);
-            break;
-        }
-
-        switch (request.stdout_action) {
-        case linux_container_start_vm_request::CLOSE_FD:
-            proc_stdout = -1;
-            break;
-        case linux_container_start_vm_request::SHARE_PARENT:
-            proc_stdout = STDOUT_FILENO;
-            break;
-        case linux_container_start_vm_request::USE_PIPE:
-            for (int i = 1 ; i != 4 ; ++i) {
-                if (fds[i] != -1) {
-                    proc_stdout = fds[i];
-                    fds[i] = -1;
-                    break;
-                }
-            }
-            assert(proc_stdout != -1);
-            break;
-        }
-
-        switch (request.stderr_action) {
-        case linux_container_start_vm_request::CLOSE_FD:
-            proc_stderr = -1;
-            break;
-        case linux_container_start_vm_request::SHARE_PARENT:
-            proc_stderr = STDERR_FILENO;
-            proc_stderr_has_color = request.stderr_has_color;
-            break;
-        case linux_container_start_vm_request::USE_PIPE:
-            for (int i = 1 ; i != 4 ; ++i) {
-                if (fds[i] != -1) {
-                    proc_stderr = fds[i];
-                    fds[i] = -1;
-                    break;
-                }
-            }
-            assert(proc_stderr != -1);
-            break;
-        }
-        assert(fds[1] == -1);
-        assert(fds[2] == -1);
-        assert(fds[3] == -1);
-
-        has_lua_hook = request.has_lua_hook;
+        apply_request(request, fds);
 
         linux_container_start_vm_reply reply;
         int pidfd = -1;
         request.clone_flags |= CLONE_PIDFD | SIGCHLD;
-        reply.childpid = clone(child_main, clone_stack_address,
-                               request.clone_flags, /*arg=*/nullptr, &pidfd);
+        reply.childpid = take_zygote(request, fds, pidfd);
+        reply.from_zygote = (reply.childpid != -1);
+        if (reply.childpid == -1) {
+            reply.childpid = clone(child_main, clone_stack_address,
+                                   request.clone_flags, /*arg=*/nullptr,
+                                   &pidfd);
+        }
         reply.error = (reply.childpid == -1) ? errno : 0;
 
         switch (proc_stdin) {
@@ -1357,6 +1470,9 @@ int app_context::linux_namespaces_service_main(int sockfd)
         close(inboxfd);
         if (pidfd != -1)
             close(pidfd);
+
+        // only after the reply so the caller doesn't wait for them
+        spawn_zygotes(request);
     }
 }
 
@@ -1165,6 +1165,61 @@ static int system_exit(lua_State* L)
     return lua_yield(L, 0);
 }
 
+static int system_memory_usage(lua_State* L)
+{
+    auto& vm_ctx = get_vm_context(L);
+    lua_pushnumber(L, vm_ctx.memory_usage());
+    lua_pushnumber(L, vm_ctx.peak_memory_usage());
+    if (auto limit = vm_ctx.memory_limit() ; limit != 0)
+        lua_pushnumber(L, limit);
+    else
+        lua_pushnil(L);
+    return 3;
+}
+
+static int system_scheduler_stats(lua_State* L)
+{
+    auto& vm_ctx = get_vm_context(L);
+    auto stats = vm_ctx.stats().snapshot();
+    using seconds = std::chrono::duration<lua_Number>;
+    lua_createtable(L, /*narr=*/0, /*nrec=*/6);
+
+    lua_pushliteral(L, "resumes");
+    lua_pushnumber(L, stats.resumes);
+    lua_rawset(L, -3);
+
+    lua_pushliteral(L, "resume_time");
+    lua_pushnumber(L, std::chrono::duration_cast<seconds>(
+        stats.resume_time).count());
+    lua_rawset(L, -3);
+
+    lua_pushliteral(L, "longest_slice");
+    lua_pushnumber(L, std::chrono::duration_cast<seconds>(
+        stats.longest_slice).count());
+    lua_rawset(L, -3);
+
+    lua_pushliteral(L, "pending_handlers");
+    lua_pushnumber(L, stats.pending_handlers);
+    lua_rawset(L, -3);
+
+    // the snapshot only sees messages already collected from the inbox
+    lua_pushliteral(L, "inbox_backlog");
+    lua_pushnumber(L, vm_ctx.inbox_backlog());
+    lua_rawset(L, -3);
+
+    if (auto core = vm_ctx.core() ; core) {
+        auto& cores = vm_ctx.appctx.cores;
+        auto it = std::find_if(
+            cores.begin(), cores.end(),
+            [core](const app_context::core_context& c) { return &c == core; });
+        lua_pushliteral(L, "core");
+        lua_pushinteger(L, (it - cores.begin()) + 1);
+        lua_rawset(L, -3);
+    }
+
+    return 1;
+}
+
 #if BOOST_OS_UNIX
 static int system_getresuid(lua_State* L)
 {
@@ -3781,6 +3836,18 @@ static int system_mt_index(lua_State* L)
                     return 1;
                 }),
 #endif // BOOST_OS_UNIX
+            hana::make_pair(
+                BOOST_HANA_STRING("memory_usage"),
+                [](lua_State* L) -> int {
+                    lua_pushcfunction(L, system_memory_usage);
+                    return 1;
+                }),
+            hana::make_pair(
+                BOOST_HANA_STRING("scheduler_stats"),
+                [](lua_State* L) -> int {
+                    lua_pushcfunction(L, system_scheduler_stats);
+                    return 1;
+                }),
             hana::make_pair(
                 BOOST_HANA_STRING("exit"),
                 [](lua_State* L) -> int {
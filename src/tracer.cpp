@@ -0,0 +1,204 @@
+/* Copyright (c) 2023 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#include <iterator>
+
+#include <fmt/format.h>
+
+#include <boost/nowide/fstream.hpp>
+
+#include <emilua/tracer.hpp>
+
+namespace emilua {
+
+namespace nowide = boost::nowide;
+
+static std::atomic_uint64_t next_tid = 1;
+
+static std::uint64_t current_tid()
+{
+    thread_local std::uint64_t tid = next_tid++;
+    return tid;
+}
+
+static double timestamp(const app_context::tracer_state& tracer,
+                        std::chrono::steady_clock::time_point tp)
+{
+    return std::chrono::duration<double, std::micro>{tp - tracer.epoch}
+        .count();
+}
+
+static void append_json_string(std::string& out, std::string_view str)
+{
+    out.push_back('"');
+    for (char c: str) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                fmt::format_to(std::back_inserter(out),
+                               FMT_STRING("\\u{:04x}"), static_cast<int>(c));
+            } else {
+                out.push_back(c);
+            }
+        }
+    }
+    out.push_back('"');
+}
+
+static void record(app_context::tracer_state& tracer, std::string event)
+{
+    std::lock_guard guard{tracer.mtx};
+    tracer.events.emplace_back(std::move(event));
+}
+
+void trace_vm_start(vm_context& vm_ctx, std::string_view name)
+{
+    auto& tracer = *vm_ctx.appctx.tracer;
+    vm_ctx.trace_pid = tracer.next_pid++;
+
+    std::string event = fmt::format(
+        FMT_STRING(R"({{"ph":"M","name":"process_name","pid":{},)"
+                   R"("args":{{"name":)"),
+        vm_ctx.trace_pid);
+    append_json_string(event, name);
+    event += "}}";
+    record(tracer, std::move(event));
+}
+
+void trace_fiber_spawn(vm_context& vm_ctx, lua_State* new_fiber)
+{
+    auto& tracer = *vm_ctx.appctx.tracer;
+    record(tracer, fmt::format(
+        FMT_STRING(R"({{"ph":"i","s":"t","cat":"fiber","name":"spawn",)"
+                   R"("ts":{:.3f},"pid":{},"tid":{},)"
+                   R"("args":{{"fiber":"{}"}}}})"),
+        timestamp(tracer, std::chrono::steady_clock::now()),
+        vm_ctx.trace_pid, current_tid(), static_cast<void*>(new_fiber)));
+}
+
+void trace_fiber_slice(vm_context& vm_ctx, lua_State* fiber,
+                       std::chrono::steady_clock::time_point start,
+                       std::chrono::steady_clock::time_point end,
+                       bool finished)
+{
+    auto& tracer = *vm_ctx.appctx.tracer;
+    auto tid = current_tid();
+    record(tracer, fmt::format(
+        FMT_STRING(R"({{"ph":"X","cat":"fiber","name":"{}",)"
+                   R"("ts":{:.3f},"dur":{:.3f},"pid":{},"tid":{},)"
+                   R"("args":{{"fiber":"{}"}}}})"),
+        fiber == vm_ctx.L() ? "main fiber" : "fiber",
+        timestamp(tracer, start), timestamp(tracer, end) -
+        timestamp(tracer, start), vm_ctx.trace_pid, tid,
+        static_cast<void*>(fiber)));
+
+    if (finished) {
+        record(tracer, fmt::format(
+            FMT_STRING(R"({{"ph":"i","s":"t","cat":"fiber","name":"finish",)"
+                       R"("ts":{:.3f},"pid":{},"tid":{},)"
+                       R"("args":{{"fiber":"{}"}}}})"),
+            timestamp(tracer, end), vm_ctx.trace_pid, tid,
+            static_cast<void*>(fiber)));
+    }
+}
+
+void trace_async_op_begin(vm_context& vm_ctx)
+{
+    lua_State* fiber = vm_ctx.current_fiber();
+    auto& fiber_data = vm_ctx.current_fiber_data();
+
+    // the previous operation completed without suspending the fiber
+    if (!fiber_data.trace_async_op.empty())
+        trace_async_op_end(vm_ctx, fiber);
+
+    lua_Debug ar;
+    if (lua_getstack(fiber, 0, &ar) && lua_getinfo(fiber, "n", &ar) &&
+        ar.name) {
+        fiber_data.trace_async_op = ar.name;
+    } else {
+        fiber_data.trace_async_op = "async operation";
+    }
+
+    auto& tracer = *vm_ctx.appctx.tracer;
+    std::string event = fmt::format(
+        FMT_STRING(R"({{"ph":"b","cat":"async","id":"{}","ts":{:.3f},)"
+                   R"("pid":{},"tid":{},"name":)"),
+        static_cast<void*>(fiber),
+        timestamp(tracer, std::chrono::steady_clock::now()),
+        vm_ctx.trace_pid, current_tid());
+    append_json_string(event, fiber_data.trace_async_op);
+    event.push_back('}');
+    record(tracer, std::move(event));
+}
+
+void trace_async_op_end(vm_context& vm_ctx, lua_State* fiber)
+{
+    auto& fiber_data = vm_ctx.fiber_data(fiber);
+    auto& tracer = *vm_ctx.appctx.tracer;
+    std::string event = fmt::format(
+        FMT_STRING(R"({{"ph":"e","cat":"async","id":"{}","ts":{:.3f},)"
+                   R"("pid":{},"tid":{},"name":)"),
+        static_cast<void*>(fiber),
+        timestamp(tracer, std::chrono::steady_clock::now()),
+        vm_ctx.trace_pid, current_tid());
+    append_json_string(event, fiber_data.trace_async_op);
+    event.push_back('}');
+    record(tracer, std::move(event));
+    fiber_data.trace_async_op.clear();
+}
+
+std::uint64_t trace_message_send(vm_context& vm_ctx)
+{
+    auto& tracer = *vm_ctx.appctx.tracer;
+    auto flow_id = tracer.next_flow_id++;
+    record(tracer, fmt::format(
+        FMT_STRING(R"({{"ph":"s","cat":"actor","name":"message","id":{},)"
+                   R"("ts":{:.3f},"pid":{},"tid":{}}})"),
+        flow_id, timestamp(tracer, std::chrono::steady_clock::now()),
+        vm_ctx.trace_pid, current_tid()));
+    return flow_id;
+}
+
+void trace_message_receive(vm_context& vm_ctx, std::uint64_t flow_id)
+{
+    if (flow_id == 0)
+        return;
+
+    // binds to the slice that consumes the message (i.e. the next one if the
+    // receiver is suspended)
+    auto& tracer = *vm_ctx.appctx.tracer;
+    record(tracer, fmt::format(
+        FMT_STRING(R"({{"ph":"f","cat":"actor","name":"message","id":{},)"
+                   R"("ts":{:.3f},"pid":{},"tid":{}}})"),
+        flow_id, timestamp(tracer, std::chrono::steady_clock::now()),
+        vm_ctx.trace_pid, current_tid()));
+}
+
+void write_trace(app_context& appctx, const std::filesystem::path& path)
+{
+    auto& tracer = *appctx.tracer;
+    std::lock_guard guard{tracer.mtx};
+
+    nowide::ofstream out{path, std::ios::out | std::ios::trunc};
+    out.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& e: tracer.events) {
+        if (!first)
+            out << ",\n";
+        first = false;
+        out << e;
+    }
+    out << "\n]}\n";
+    out.close();
+}
+
+} // namespace emilua
@@ -0,0 +1,17 @@
+local system = require('system')
+
+if _CONTEXT == 'main' then
+    local _, _, limit = system.memory_usage()
+    assert(limit == nil)
+
+    spawn_vm('.', { memory_limit = 16 * 1024 * 1024 })
+else assert(_CONTEXT == 'worker')
+    local current, peak, limit = system.memory_usage()
+    assert(limit == 16 * 1024 * 1024)
+    assert(current <= peak and peak <= limit)
+
+    local t = {}
+    for i = 1, math.huge do
+        t[i] = tostring(i):rep(100)
+    end
+end
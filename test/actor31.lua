@@ -0,0 +1,22 @@
+-- byte_span messages are moved to the receiver
+local inbox = require('inbox')
+
+if _CONTEXT == 'main' then
+    local ch = spawn_vm('.')
+
+    local buf = byte_span.append('hello')
+    ch:send(buf)
+    print(#buf, buf.capacity)
+
+    -- shared with a slice, so the receiver gets a copy
+    local buf2 = byte_span.append('world')
+    local slice = buf2:slice(1, 3)
+    ch:send{ inbox, buf2 }
+    print(#buf2, tostring(slice))
+
+    print(inbox:receive())
+else assert(_CONTEXT == 'worker')
+    local m1 = inbox:receive()
+    local m2 = inbox:receive()
+    m2[1]:send(tostring(m1) .. ' ' .. tostring(m2[2]))
+end
@@ -0,0 +1,15 @@
+local inbox = require('inbox')
+
+if _CONTEXT == 'main' then
+    local ch = spawn_vm('.')
+    ch:send(inbox)
+    ch:send_many{ 'a', 'b', { foo = 'c' } }
+    print('sent')
+    print(inbox:receive())
+else assert(_CONTEXT == 'worker')
+    local reply = inbox:receive()
+    local msgs = inbox:receive_many(2)
+    local more = inbox:receive_many(10)
+    reply:send(string.format('%d %s %s %d %s', #msgs, msgs[1], msgs[2],
+                             #more, more[1].foo))
+end
@@ -0,0 +1,27 @@
+local inbox = require('inbox')
+
+if _CONTEXT == 'main' then
+    inbox:set_capacity(2)
+    local ch = spawn_vm('.')
+    ch:send(inbox)
+    ch:send('go')
+    print(inbox:receive(), inbox:receive(), inbox:receive())
+
+    inbox:set_capacity(2, 'drop_oldest')
+    ch:send('ready')
+    ch:send('go')
+    print(inbox:receive(), inbox:receive())
+else assert(_CONTEXT == 'worker')
+    local reply = inbox:receive()
+    local a = reply:try_send(1)
+    local b = reply:try_send(2)
+    local c = reply:try_send(3)
+    assert(inbox:receive() == 'go')
+    reply:send(string.format('%s %s %s', a, b, c))
+
+    assert(inbox:receive() == 'ready')
+    reply:send('a')
+    reply:send('b')
+    reply:send('c')
+    assert(inbox:receive() == 'go')
+end
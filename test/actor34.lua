@@ -0,0 +1,51 @@
+-- Deep backlog of blocked senders with half of them interrupted before the
+-- receiver drains the inbox.
+
+local inbox = require('inbox')
+
+local N = 20000
+
+if _CONTEXT == 'main' then
+    local ch = spawn_vm('.')
+    ch:send(inbox)
+
+    local senders = {}
+    for i = 1, N do
+        senders[i] = spawn(function()
+            ch:send(i)
+        end)
+    end
+    this_fiber.yield()
+
+    for i = 1, N, 2 do
+        senders[i]:interrupt()
+    end
+    for i = 1, N, 2 do
+        senders[i]:join()
+        assert(senders[i].interruption_caught == true)
+    end
+
+    assert(inbox:receive() == 'ready')
+    ch:send('end')
+    print(inbox:receive())
+
+    for i = 2, N, 2 do
+        senders[i]:join()
+        assert(senders[i].interruption_caught == false)
+    end
+    print('joined')
+else assert(_CONTEXT == 'worker')
+    local reply = inbox:receive()
+    reply:send('ready')
+
+    local count, sum = 0, 0
+    while true do
+        local msg = inbox:receive()
+        if msg == 'end' then
+            break
+        end
+        count = count + 1
+        sum = sum + msg
+    end
+    reply:send(string.format('%d %d', count, sum))
+end
@@ -0,0 +1,34 @@
+-- broadcast() serializes once and delivers to every subscriber without
+-- waiting for them
+local inbox = require('inbox')
+
+if _CONTEXT == 'main' then
+    local chans = {}
+    for i = 1, 4 do
+        -- the last one has no capacity and misses the broadcast
+        chans[i] = spawn_vm('.', { inbox_capacity = i < 4 and 4 or 0 })
+        chans[i]:send(inbox)
+        chans[i]:send(i)
+    end
+
+    local raw = byte_span.append('xyz')
+    local n, missed = broadcast(chans, { sym = 'ABC', px = 10.5, raw = raw })
+    print(n, table.concat(missed, ' '))
+    print(#raw)
+    for _, i in ipairs(missed) do
+        chans[i]:send({ sym = 'none', px = 0, raw = 'none' })
+    end
+
+    local replies = {}
+    for i = 1, 4 do
+        replies[i] = inbox:receive()
+    end
+    table.sort(replies)
+    print(table.concat(replies, '\n'))
+else assert(_CONTEXT == 'worker')
+    local reply = inbox:receive()
+    local id = inbox:receive()
+    local tick = inbox:receive()
+    reply:send(string.format('%d %s %s %s', id, tick.sym, tick.px,
+                             tostring(tick.raw)))
+end
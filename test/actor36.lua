@@ -0,0 +1,72 @@
+-- new_router() spreads sends among worker actors
+local inbox = require('inbox')
+
+if _CONTEXT == 'main' then
+    local chans = {}
+    for i = 1, 3 do
+        chans[i] = spawn_vm('.')
+        chans[i]:send(inbox)
+        chans[i]:send(i)
+    end
+
+    local rr = new_router(chans)
+    print(rr.size)
+    for i = 1, 6 do
+        rr:send(i)
+    end
+
+    local hashed = new_router(chans, 'hash')
+    for _ = 1, 3 do
+        hashed:send('h', 'some key')
+    end
+
+    local lb = new_router(chans, 'least_backlog')
+    for _ = 1, 3 do
+        lb:send('l')
+    end
+
+    -- closed tx-channels are skipped just like workers that are gone
+    local extra = spawn_vm('.')
+    extra:send(inbox)
+    extra:send(4)
+    extra:send('stop')
+    local partial = new_router({extra, chans[1]})
+    local partial_hashed = new_router({extra}, 'hash')
+    extra:close()
+    partial:send(7)
+    partial:send(8)
+    local ok, e = pcall(partial_hashed.send, partial_hashed, 'h', 'some key')
+    print(ok, e.code == 15) --< errc::channel_closed
+
+    for _, ch in ipairs(chans) do
+        ch:send('stop')
+    end
+
+    local replies = {}
+    for i = 1, 4 do
+        replies[i] = inbox:receive()
+    end
+    table.sort(replies)
+    print(table.concat(replies, '\n'))
+else assert(_CONTEXT == 'worker')
+    local reply = inbox:receive()
+    local id = inbox:receive()
+    local numbers = {}
+    local nh, nl = 0, 0
+    while true do
+        local msg = inbox:receive()
+        if msg == 'stop' then
+            break
+        elseif msg == 'h' then
+            nh = nh + 1
+        elseif msg == 'l' then
+            nl = nl + 1
+        else
+            numbers[#numbers + 1] = msg
+        end
+    end
+    -- every hashed message goes to the same worker
+    assert(nh == 0 or nh == 3)
+    reply:send(string.format('%d: %s (l=%d)', id, table.concat(numbers, ' '),
+                             nl))
+end
@@ -0,0 +1,20 @@
+-- receive{ timeout = secs } bounds how long the fiber stays parked
+local inbox = require('inbox')
+
+if _CONTEXT == 'main' then
+    local ok, e = pcall(function() inbox:receive{ timeout = 0 } end)
+    print(ok, e.code == 110) --< errc::timed_out
+
+    local ch = spawn_vm('.')
+    ch:send(inbox)
+
+    ok, e = pcall(function() inbox:receive{ timeout = 0.05 } end)
+    print(ok, e.code == 110)
+
+    ch:send('go')
+    print(inbox:receive{ timeout = 5 })
+else assert(_CONTEXT == 'worker')
+    local reply = inbox:receive()
+    inbox:receive()
+    reply:send('pong')
+end
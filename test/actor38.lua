@@ -0,0 +1,35 @@
+-- chan:transfer() moves sockets and file descriptors to another actor
+local stream = require('stream')
+local inbox = require('inbox')
+local unix = require('unix')
+
+if _CONTEXT == 'main' then
+    local ch = spawn_vm('.')
+    ch:send(inbox)
+
+    local a, b = unix.stream_socket.pair()
+    ch:transfer(b)
+    local ok, e = pcall(ch.transfer, ch, b)
+    print(ok, e.code == 9) --< errc::bad_file_descriptor
+
+    local c, d = unix.stream_socket.pair()
+    local fd = d:release()
+    ch:transfer(fd)
+    ok, e = pcall(ch.transfer, ch, fd)
+    print(ok, e.code == 16) --< errc::device_or_resource_busy
+
+    for _, s in ipairs{a, c} do
+        local buf = byte_span.new(5)
+        stream.read_all(s, buf)
+        print(buf)
+    end
+    print(inbox:receive())
+else assert(_CONTEXT == 'worker')
+    local reply = inbox:receive()
+    for _, msg in ipairs{'hello', 'world'} do
+        local s = unix.stream_socket.new()
+        s:assign(inbox:receive())
+        stream.write_all(s, msg)
+    end
+    reply:send('done')
+end
@@ -0,0 +1,27 @@
+-- a byte_span is handed back to the sender if its message isn't received
+local sleep = require('time').sleep
+local inbox = require('inbox')
+
+if _CONTEXT == 'main' then
+    local ch = spawn_vm('.')
+    ch:send(inbox)
+    inbox:receive()
+
+    local buf = byte_span.append('hello')
+    local f = spawn(function() ch:send(buf) end)
+    sleep(0.1)
+    f:interrupt()
+    pcall(f.join, f)
+    print(#buf, buf)
+
+    -- the worker closes its inbox while the message is waiting for a receiver
+    local ok, e = pcall(ch.send, ch, { data = buf })
+    print(ok, e.code == 15) --< errc::channel_closed
+    print(#buf, buf)
+else assert(_CONTEXT == 'worker')
+    local reply = inbox:receive()
+    reply:send('ready')
+    sleep(0.2)
+    inbox:close()
+    sleep(0.2)
+end
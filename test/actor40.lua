@@ -0,0 +1,38 @@
+-- chan:transfer() puts the file descriptor back if the message isn't received
+local stream = require('stream')
+local sleep = require('time').sleep
+local inbox = require('inbox')
+local unix = require('unix')
+
+if _CONTEXT == 'main' then
+    local ch = spawn_vm('.')
+    ch:send(inbox)
+    inbox:receive()
+
+    local a, b = unix.stream_socket.pair()
+    local f = spawn(function() ch:transfer(b) end)
+    sleep(0.1)
+    f:interrupt()
+    pcall(f.join, f)
+    stream.write_all(b, 'hello')
+
+    -- the worker closes its inbox while the message is waiting for a receiver
+    local c, d = unix.stream_socket.pair()
+    local fd = d:release()
+    local ok, e = pcall(ch.transfer, ch, fd)
+    print(ok, e.code == 15) --< errc::channel_closed
+    d:assign(fd)
+    stream.write_all(d, 'world')
+
+    for _, s in ipairs{a, c} do
+        local buf = byte_span.new(5)
+        stream.read_all(s, buf)
+        print(buf)
+    end
+else assert(_CONTEXT == 'worker')
+    local reply = inbox:receive()
+    reply:send('ready')
+    sleep(0.2)
+    inbox:close()
+    sleep(0.2)
+end
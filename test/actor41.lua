@@ -0,0 +1,29 @@
+-- system.scheduler_stats() reports the scheduler counters of the calling VM
+local system = require('system')
+local sleep = require('time').sleep
+local inbox = require('inbox')
+
+if _CONTEXT == 'main' then
+    inbox:set_capacity(3)
+    local ch = spawn_vm('.')
+    ch:send(inbox)
+    sleep(0.1)
+
+    local s0 = system.scheduler_stats()
+    print(s0.inbox_backlog)
+    for _ = 1, 3 do
+        inbox:receive()
+    end
+    sleep(0.01)
+
+    local s1 = system.scheduler_stats()
+    print(s1.inbox_backlog, s1.resumes > s0.resumes)
+    print(s1.resume_time > 0, s1.longest_slice > 0,
+          s1.longest_slice <= s1.resume_time)
+    print(type(s1.pending_handlers), s1.core)
+else assert(_CONTEXT == 'worker')
+    local reply = inbox:receive()
+    for i = 1, 3 do
+        reply:send(i)
+    end
+end
@@ -0,0 +1,42 @@
+-- A drop_oldest mailbox stays bounded while its receiver isn't receiving
+local system = require('system')
+local sleep = require('time').sleep
+local inbox = require('inbox')
+
+if _CONTEXT == 'main' then
+    inbox:set_capacity(2, 'drop_oldest')
+    local ch = spawn_vm('.')
+    ch:send(inbox)
+
+    -- the receiver's thread trims the mailbox between the sends
+    ch:send('yield')
+    sleep(0.2)
+    print(system.scheduler_stats().inbox_backlog)
+    print(inbox:receive(), inbox:receive())
+
+    -- the sender never yields so the mailbox is never trimmed meanwhile
+    ch:send('busy')
+    sleep(0.2)
+    print(system.scheduler_stats().inbox_backlog)
+    print(inbox:receive(), inbox:receive())
+    ch:send('report')
+    print(inbox:receive())
+else assert(_CONTEXT == 'worker')
+    local reply = inbox:receive()
+
+    assert(inbox:receive() == 'yield')
+    for i = 1, 1000 do
+        reply:send(i)
+        this_fiber.yield()
+    end
+
+    assert(inbox:receive() == 'busy')
+    local nbuffered = 0
+    for i = 1, 1000 do
+        if reply:try_send(i) then
+            nbuffered = nbuffered + 1
+        end
+    end
+    assert(inbox:receive() == 'report')
+    reply:send(nbuffered)
+end
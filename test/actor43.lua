@@ -0,0 +1,9 @@
+-- spawn_vm() refuses memory limits that don't fit in the VM's allocator
+if _CONTEXT == 'main' then
+    for _, limit in ipairs{0 / 0, math.huge, -math.huge, 0, 2 ^ 64, '1'} do
+        local ok, e = pcall(spawn_vm, '.', { memory_limit = limit })
+        --< errc::argument_out_of_domain (33), errc::value_too_large (75) or
+        --< errc::invalid_argument (22)
+        print(ok, e.code)
+    end
+end
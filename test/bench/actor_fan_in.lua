@@ -0,0 +1,40 @@
+-- Measures how many messages/s a single actor receives as the number of
+-- producers (each one on its own thread) grows. Run both with rendezvous sends
+-- and with a bounded mailbox (senders don't wait for the receiver).
+
+local inbox = require('inbox')
+
+local N = 20000
+
+if _CONTEXT ~= 'main' then
+    local sink = inbox:receive()
+    for i = 1, N do
+        sink:send(i)
+    end
+    return
+end
+
+local clock = require('time').steady_clock
+
+for _, capacity in ipairs{ 0, 1024 } do
+    inbox:set_capacity(capacity)
+    for _, nproducers in ipairs{ 1, 2, 4, 8 } do
+        local producers = {}
+        for i = 1, nproducers do
+            producers[i] = spawn_vm('.', { inherit_context = false })
+        end
+
+        local start = clock.now().seconds_since_epoch
+        for _, ch in ipairs(producers) do
+            ch:send(inbox)
+        end
+        for _ = 1, nproducers * N do
+            inbox:receive()
+        end
+        local elapsed = clock.now().seconds_since_epoch - start
+        print(string.format('capacity=%d producers=%d: %d messages in %.3fs ' ..
+                            '(%.0f messages/s)', capacity, nproducers,
+                            nproducers * N, elapsed,
+                            nproducers * N / elapsed))
+    end
+end
@@ -0,0 +1,31 @@
+-- Measures round-trip latency between two actors (send() + receive() in both
+-- directions) for actors sharing a thread and actors on different threads.
+
+local inbox = require('inbox')
+
+local N = 100000
+
+if _CONTEXT ~= 'main' then
+    local peer = inbox:receive()
+    for _ = 1, N do
+        peer:send(inbox:receive())
+    end
+    return
+end
+
+local clock = require('time').steady_clock
+
+for _, inherit_context in ipairs{ true, false } do
+    local ch = spawn_vm('.', { inherit_context = inherit_context })
+    ch:send(inbox)
+
+    local start = clock.now().seconds_since_epoch
+    for i = 1, N do
+        ch:send(i)
+        inbox:receive()
+    end
+    local elapsed = clock.now().seconds_since_epoch - start
+    print(string.format('inherit_context=%s: %d round trips in %.3fs ' ..
+                        '(%.0f messages/s)', inherit_context, N, elapsed,
+                        2 * N / elapsed))
+end
@@ -0,0 +1,40 @@
+-- Measures send()+receive() throughput for large nested table messages (e.g.
+-- configuration broadcasts).
+
+local inbox = require('inbox')
+
+local N = 2000
+
+if _CONTEXT ~= 'main' then
+    local reply = inbox:receive()
+    for _ = 1, N do
+        inbox:receive()
+    end
+    reply:send('done')
+    return
+end
+
+local clock = require('time').steady_clock
+
+-- 100 sections with 20 string keys and a 20-element array each
+local msg = {}
+for i = 1, 100 do
+    local section = { name = 'section' .. i, enabled = true, weights = {} }
+    for j = 1, 20 do
+        section['key' .. j] = 'value' .. j
+        section.weights[j] = j / 10
+    end
+    msg['section' .. i] = section
+end
+
+local ch = spawn_vm('.')
+ch:send(inbox)
+
+local start = clock.now().seconds_since_epoch
+for _ = 1, N do
+    ch:send(msg)
+end
+inbox:receive()
+local elapsed = clock.now().seconds_since_epoch - start
+print(string.format('%d messages in %.3fs (%.0f messages/s)',
+                    N, elapsed, N / elapsed))
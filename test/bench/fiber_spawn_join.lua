@@ -0,0 +1,34 @@
+-- Measures fiber spawn()+join() throughput.
+--
+-- The "cold" round keeps every fiber alive until all of them are spawned so
+-- each spawn() has to create a new fiber from scratch. The "warm" round joins
+-- each fiber before spawning the next one so finished fibers are reused.
+
+local clock = require('time').steady_clock
+
+local N = 200000
+
+local function report(name, start)
+    local elapsed = clock.now().seconds_since_epoch - start.seconds_since_epoch
+    print(string.format('%s: %d fibers in %.3fs (%.0f fibers/s)',
+                        name, N, elapsed, N / elapsed))
+end
+
+local function noop() end
+
+local fibers = {}
+local start = clock.now()
+for i = 1, N do
+    fibers[i] = spawn(noop)
+end
+for i = 1, N do
+    fibers[i]:join()
+end
+report('cold', start)
+fibers = nil
+
+start = clock.now()
+for _ = 1, N do
+    spawn(noop):join()
+end
+report('warm', start)
@@ -0,0 +1,29 @@
+-- Measures spawn_vm() latency for bursts of actors.
+--
+-- Run it with and without `--vm-pool-size` to compare. Each round sleeps
+-- before the next burst so the pool has time to refill.
+
+if _CONTEXT ~= 'main' then
+    return
+end
+
+local clock = require('time').steady_clock
+local sleep = require('time').sleep
+
+local BURST = 32
+local ROUNDS = 10
+
+local total = 0
+for round = 1, ROUNDS do
+    local start = clock.now().seconds_since_epoch
+    for _ = 1, BURST do
+        spawn_vm('.')
+    end
+    local elapsed = clock.now().seconds_since_epoch - start
+    total = total + elapsed
+    print(string.format('round %d: %d VMs in %.3fs (%.3fms per VM)',
+                        round, BURST, elapsed, elapsed / BURST * 1000))
+    sleep(0.5)
+end
+print(string.format('average: %.3fms per VM',
+                    total / (BURST * ROUNDS) * 1000))
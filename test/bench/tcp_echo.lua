@@ -0,0 +1,68 @@
+-- Measures round trips over loopback TCP connections.
+--
+-- Each client fiber writes a small message and waits for the echo before
+-- sending the next one, so the run time is dominated by the per-operation
+-- overhead of async reads and writes (handler allocation included) rather
+-- than by bandwidth.
+
+local stream = require('stream')
+local ip = require('ip')
+local clock = require('time').steady_clock
+
+local CONNECTIONS = 16
+local ROUND_TRIPS = 20000
+local MSG_SIZE = 64
+
+local acceptor = ip.tcp.acceptor.new()
+acceptor:open('v4')
+acceptor:set_option('reuse_address', true)
+acceptor:bind(ip.address.loopback_v4(), 0)
+acceptor:listen()
+local port = acceptor.local_port
+
+local function echo(sock)
+    local buf = byte_span.new(MSG_SIZE)
+    while true do
+        local ok, nread = pcall(function() return sock:read_some(buf) end)
+        if not ok then
+            break
+        end
+        stream.write_all(sock, buf:slice(1, nread))
+    end
+end
+
+spawn(function()
+    for _ = 1, CONNECTIONS do
+        spawn(echo, acceptor:accept()):detach()
+    end
+end):detach()
+
+local function client()
+    local sock = ip.tcp.socket.new()
+    sock:connect(ip.address.loopback_v4(), port)
+    sock:set_option('tcp_no_delay', true)
+    local msg = byte_span.append(string.rep('x', MSG_SIZE))
+    local buf = byte_span.new(MSG_SIZE)
+    for _ = 1, ROUND_TRIPS do
+        stream.write_all(sock, msg)
+        local nread = 0
+        while nread < MSG_SIZE do
+            nread = nread + sock:read_some(buf:slice(nread + 1))
+        end
+    end
+    sock:close()
+end
+
+local start = clock.now().seconds_since_epoch
+local clients = {}
+for i = 1, CONNECTIONS do
+    clients[i] = spawn(client)
+end
+for _, c in ipairs(clients) do
+    c:join()
+end
+local elapsed = clock.now().seconds_since_epoch - start
+local total = CONNECTIONS * ROUND_TRIPS
+print(string.format('%d round trips in %.3fs (%.0f round trips/s)',
+                    total, elapsed, total / elapsed))
+acceptor:close()
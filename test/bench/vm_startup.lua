@@ -0,0 +1,42 @@
+-- Measures VM creation time and the memory footprint of a fresh VM.
+--
+-- Workers report their Lua heap size before importing anything (other than
+-- `inbox`) and again after importing `json`.
+
+local N = 200
+
+if _CONTEXT == 'worker' then
+    collectgarbage('collect')
+    local bare = collectgarbage('count')
+    local inbox = require('inbox')
+    local master = inbox:receive()
+    require('json')
+    collectgarbage('collect')
+    master:send({ bare = bare, json = collectgarbage('count') })
+    return
+end
+
+local clock = require('time').steady_clock
+local inbox = require('inbox')
+
+local workers = {}
+local start = clock.now().seconds_since_epoch
+for i = 1, N do
+    workers[i] = spawn_vm('.')
+end
+local elapsed = clock.now().seconds_since_epoch - start
+print(string.format('spawn_vm: %d VMs in %.3fs (%.3fms per VM)',
+                    N, elapsed, elapsed / N * 1000))
+
+for i = 1, N do
+    workers[i]:send(inbox)
+end
+
+local bare, json = 0, 0
+for _ = 1, N do
+    local m = inbox:receive()
+    bare = bare + m.bare
+    json = json + m.json
+end
+print(string.format('memory: %.1f KiB per VM (%.1f KiB after json import)',
+                    bare / N, json / N))
@@ -0,0 +1,48 @@
+-- Modules are recompiled when their mtime changes and EMILUA_BYTECODE_CACHE_DIR
+-- entries are keyed by emilua/LuaJIT version, path and mtime
+local system = require 'system'
+local fs = require 'filesystem'
+local run_child = require('./cli_libspawn').run_child
+local read_file = require('./cli_libspawn').read_file
+
+local fixtures = fs.absolute(fs.path.new(system.arguments[2])):parent_path() /
+    'bytecode_cache1_app'
+local dir = fs.temp_directory_path() /
+    ('emilua-bytecode-cache1-' .. system.getpid())
+local cache = dir / 'cache'
+local app = dir / 'app.lua'
+fs.create_directory(dir)
+fs.create_directory(cache)
+
+local function run(environment)
+    environment = environment or {}
+    environment.EMILUA_BYTECODE_CACHE_DIR = tostring(cache)
+    local out = run_child(nil, environment, tostring(app))
+    print((out:gsub('\n$', '')))
+end
+
+-- in-memory cache: the worker spawned after the rewrite sees the new source
+fs.copy_file(fixtures / 'v1.lua', app)
+run{ BYTECODE_CACHE1_NEXT = tostring(fixtures / 'v2.lua') }
+
+local entries = {}
+for entry in fs.directory_iterator(cache) do
+    entries[#entries + 1] = entry.path
+end
+print(#entries, tostring(entries[1]:extension()))
+local contents = read_file(tostring(entries[1]))
+print(contents:sub(1, #'emilua ') == 'emilua ',
+      contents:find('\n' .. tostring(app) .. '\0', 1, true) ~= nil)
+
+-- on-disk cache: same path and mtime means the stale bytecode is still used
+local mtime = fs.last_write_time(app)
+fs.copy_file(fixtures / 'v1.lua', app, { existing = 'overwrite' })
+fs.last_write_time(app, mtime)
+run()
+
+-- ...until the mtime changes
+mtime:add(10)
+fs.last_write_time(app, mtime)
+run()
+
+fs.remove_all(dir)
@@ -0,0 +1,28 @@
+-- Copied over by bytecode_cache1.lua; v2.lua only differs in VERSION
+local VERSION = 'v1'
+
+local system = require('system')
+local fs = require('filesystem')
+local inbox = require('inbox')
+
+local function worker_version()
+    spawn_vm('.'):send(inbox)
+    return inbox:receive()
+end
+
+if _CONTEXT == 'main' then
+    print(VERSION, worker_version())
+
+    local next_source = system.environment.BYTECODE_CACHE1_NEXT
+    if next_source then
+        -- replace the running script and load it again in a new VM
+        local self = fs.path.new(system.arguments[2])
+        local mtime = fs.last_write_time(self)
+        fs.copy_file(fs.path.new(next_source), self, { existing = 'overwrite' })
+        mtime:add(10)
+        fs.last_write_time(self, mtime)
+        print(VERSION, worker_version())
+    end
+else assert(_CONTEXT == 'worker')
+    inbox:receive():send(VERSION)
+end
@@ -0,0 +1,53 @@
+-- Runs the emilua binary under test on the calling test script (or on
+-- `script`) again, this time as the child (system.environment.EMILUA_TEST_CHILD
+-- is set) and with extra command-line options
+local system = require 'system'
+local pipe = require 'pipe'
+
+-- Returns whatever the process wrote to stdout. The process shares stderr.
+local function capture(program, arguments, environment)
+    local pout, pin = pipe.pair()
+    pin = pin:release()
+    local p = system.spawn{
+        program = program,
+        arguments = arguments,
+        environment = environment,
+        stdout = pin,
+        stderr = 'share'
+    }
+    pin:close()
+
+    local out = {}
+    local buf = byte_span.new(4096)
+    while true do
+        local ok, nread = pcall(pout.read_some, pout, buf)
+        if not ok then
+            break
+        end
+        out[#out + 1] = tostring(buf:slice(1, nread))
+    end
+    p:wait()
+    assert(p.exit_code == 0)
+    return table.concat(out)
+end
+
+function run_child(options, environment, script)
+    local arguments = {'emilua'}
+    for _, o in ipairs(options or {}) do
+        arguments[#arguments + 1] = o
+    end
+    arguments[#arguments + 1] = script or system.arguments[2]
+
+    local env = system.environment
+    for k, v in pairs(environment or {}) do
+        env[k] = v
+    end
+    env.EMILUA_TEST_CHILD = '1'
+
+    return capture(system.environment.EMILUA_BIN, arguments, env)
+end
+
+-- The file module is optional so binary files are read through cat(1)
+function read_file(path)
+    return capture('/bin/cat', {'cat', path}, system.environment)
+end
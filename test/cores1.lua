@@ -0,0 +1,50 @@
+-- --cores places spawned actors among the cores as told by --core-placement
+local system = require 'system'
+
+if system.environment.EMILUA_TEST_CHILD then
+    local inbox = require 'inbox'
+
+    if _CONTEXT == 'main' and system.environment.CORES1_OUTLIVE_MAIN then
+        -- the worker spawns an actor onto the main context after the main VM
+        -- is gone
+        spawn_vm('.'):send('outlive main')
+    elseif _CONTEXT == 'main' then
+        local cores = { tostring(system.scheduler_stats().core) }
+        -- workers stay alive until every worker was placed
+        local workers = {}
+        for i = 1, 4 do
+            workers[i] = spawn_vm('.')
+            workers[i]:send(inbox)
+            cores[#cores + 1] = inbox:receive()
+        end
+        for _, w in ipairs(workers) do
+            w:send('bye')
+        end
+        print(table.concat(cores, ' '))
+    else assert(_CONTEXT == 'worker')
+        local m = inbox:receive()
+        if m == 'outlive main' then
+            require('time').sleep(0.1)
+            local w = spawn_vm('.')
+            w:send(inbox)
+            local core = inbox:receive()
+            w:send('bye')
+            print(system.scheduler_stats().core .. ' ' .. core)
+        else
+            m:send(tostring(system.scheduler_stats().core))
+            inbox:receive()
+        end
+    end
+else
+    local run_child = require('./cli_libspawn').run_child
+    for _, options in ipairs{
+        {},
+        {'--cores=2'},
+        {'--cores=2', '--core-placement=round-robin'},
+        {'--cores=2', '--core-placement=least-loaded'},
+    } do
+        print((run_child(options):gsub('\n$', '')))
+    end
+    print((run_child({'--cores=2', '--core-placement=least-loaded'},
+                     { CORES1_OUTLIVE_MAIN = '1' }):gsub('\n$', '')))
+end
@@ -0,0 +1,64 @@
+-- spawn() reuses the threads of fibers that returned normally and the new
+-- fiber starts clean no matter how the previous one ended
+
+-- runs on the thread released by the previous fiber
+local function check(tag)
+    local f = spawn(function()
+        this_fiber.yield()
+        return 'clean'
+    end)
+    print(tag, f:join(), f.interruption_caught)
+end
+
+-- (a) interrupted fiber (not reused) and one that handled the interruption
+local f = spawn(function() this_fiber.yield() end)
+f:interrupt()
+f:join()
+print('a', f.interruption_caught)
+check('a')
+
+f = spawn(function()
+    local ok = pcall(this_fiber.yield)
+    return ok
+end)
+this_fiber.yield()
+f:interrupt()
+print('a', f:join(), f.interruption_caught)
+check('a')
+
+-- (b) interruption disabled until the end with a request still pending
+f = spawn(function()
+    this_fiber.disable_interruption()
+    this_fiber.yield()
+    return 'disabled'
+end)
+this_fiber.yield()
+f:interrupt()
+print('b', f:join(), f.interruption_caught)
+check('b')
+
+f = spawn(function()
+    this_fiber.yield()
+    return 'not interrupted'
+end)
+this_fiber.yield()
+f:interrupt()
+f:join()
+print('b', f.interruption_caught)
+
+-- (c) cleanup handlers only ever run for the fiber that pushed them
+f = spawn(function()
+    scope_cleanup_push(function() print('c', 'root cleanup') end)
+    scope(function()
+        scope_cleanup_push(function() print('c', 'scope cleanup') end)
+    end)
+    return 'handlers'
+end)
+print('c', f:join())
+check('c')
+
+f = spawn(function()
+    scope_cleanup_push(function() print('c', 'own cleanup') end)
+    return 'own'
+end)
+print('c', f:join())
@@ -0,0 +1,22 @@
+-- strings longer than 255 bytes travel in a sealed memfd (only into the
+-- container)
+local spawn_vm = require('./linux_namespaces_libspawn').spawn_vm
+local inbox = require 'inbox'
+
+local guest_code = [[
+    local inbox = require 'inbox'
+
+    local ch = inbox:receive()
+    local doc = inbox:receive()
+    print(#doc, doc:sub(1, 3), doc:sub(-3))
+    local m = inbox:receive()
+    print(m.name, #m.body, m.body == string.rep('xyz', 1000))
+    local ok, e = pcall(ch.send, ch, string.rep('b', 300))
+    ch:send(tostring(ok) .. ' ' .. e.code) --< errc::invalid_argument
+]]
+
+local my_channel = spawn_vm(guest_code)
+my_channel:send(inbox)
+my_channel:send('abc' .. string.rep('-', 1024 * 1024) .. 'xyz')
+my_channel:send{ name = 'doc', body = string.rep('xyz', 1000) }
+print(inbox:receive())
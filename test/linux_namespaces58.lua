@@ -0,0 +1,18 @@
+-- spawns served by pre-spawned containers (zygotes)
+local spawn_vm = require('./linux_namespaces_libspawn').spawn_vm
+local inbox = require 'inbox'
+
+local guest_code = [[
+    local inbox = require 'inbox'
+
+    local ch = inbox:receive()
+    local n = inbox:receive()
+    ch:send(n * 2)
+]]
+
+for i = 1, 4 do
+    local my_channel = spawn_vm(guest_code, 2)
+    my_channel:send(inbox)
+    my_channel:send(i)
+    print(inbox:receive(), my_channel.from_zygote)
+end
@@ -0,0 +1,62 @@
+-- Measures messaging throughput between the host and actors in Linux
+-- namespaces: round trips (ping-pong) and one-way messages from several guests
+-- (fan-in). It lives next to the tests because it reuses their spawn helper
+-- (root modules can't require their parent directory).
+
+local spawn_vm = require('./linux_namespaces_libspawn').spawn_vm
+local clock = require('time').steady_clock
+local inbox = require 'inbox'
+
+local N = 50000
+
+local guest_code = string.format([[
+    local inbox = require 'inbox'
+    local N = %d
+
+    local peer = inbox:receive()
+    local mode = inbox:receive()
+    if mode == 'ping_pong' then
+        for _ = 1, N do
+            peer:send(inbox:receive())
+        end
+    else
+        for i = 1, N do
+            peer:send(i)
+        end
+    end
+]], N)
+
+do
+    local ch = spawn_vm(guest_code)
+    ch:send(inbox)
+    ch:send('ping_pong')
+
+    local start = clock.now().seconds_since_epoch
+    for i = 1, N do
+        ch:send(i)
+        inbox:receive()
+    end
+    local elapsed = clock.now().seconds_since_epoch - start
+    print(string.format('ping_pong: %d round trips in %.3fs ' ..
+                        '(%.0f messages/s)', N, elapsed, 2 * N / elapsed))
+end
+
+for _, nproducers in ipairs{ 1, 4 } do
+    local producers = {}
+    for i = 1, nproducers do
+        producers[i] = spawn_vm(guest_code)
+    end
+
+    local start = clock.now().seconds_since_epoch
+    for _, ch in ipairs(producers) do
+        ch:send(inbox)
+        ch:send('fan_in')
+    end
+    for _ = 1, nproducers * N do
+        inbox:receive()
+    end
+    local elapsed = clock.now().seconds_since_epoch - start
+    print(string.format('fan_in producers=%d: %d messages in %.3fs ' ..
+                        '(%.0f messages/s)', nproducers, nproducers * N,
+                        elapsed, nproducers * N / elapsed))
+end
@@ -53,7 +53,7 @@ local init_script = [[
 
 local do_spawn_vm = spawn_vm
 
-function spawn_vm(guest_code)
+function spawn_vm(guest_code, zygotes)
     local shost, sguest = unix.seqpacket_socket.pair()
     sguest = sguest:release()
 
@@ -65,6 +65,7 @@ function spawn_vm(guest_code)
             new_pid = true,
             new_uts = true,
             new_ipc = true,
+            zygotes = zygotes,
             stdout = 'share',
             stderr = 'share',
             init = { script = init_script, fd = sguest }
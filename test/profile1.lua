@@ -0,0 +1,44 @@
+-- --profile keeps sampling while VMs switch faster than its interval
+local system = require 'system'
+
+if system.environment.EMILUA_TEST_CHILD then
+    local inbox = require 'inbox'
+
+    -- a fraction of the sampling interval
+    local function busy()
+        local s = ''
+        for i = 1, 200 do
+            s = s .. i
+        end
+        return s
+    end
+
+    if _CONTEXT == 'main' then
+        local ch = spawn_vm('.')
+        ch:send(inbox)
+        for _ = 1, 2000 do
+            busy()
+            ch:send('ping')
+            inbox:receive()
+        end
+    else assert(_CONTEXT == 'worker')
+        local reply = inbox:receive()
+        for _ = 1, 2000 do
+            inbox:receive()
+            busy()
+            reply:send('pong')
+        end
+    end
+else
+    local run_child = require('./cli_libspawn').run_child
+    local profile = run_child{'--profile=/dev/stdout'}
+    local nsamples = 0
+    local roots_ok = true
+    for stack, n in profile:gmatch('([^\n]*) (%d+)\n') do
+        nsamples = nsamples + n
+        if not stack:find(';%[main fiber%]') then
+            roots_ok = false
+        end
+    end
+    print(nsamples > 50, roots_ok)
+end
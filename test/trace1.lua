@@ -0,0 +1,22 @@
+-- --trace records one async op per suspension
+local system = require 'system'
+
+if system.environment.EMILUA_TEST_CHILD then
+    local sleep = require('time').sleep
+    local f = spawn(function() sleep(0.05) end)
+    f:join()
+else
+    local run_child = require('./cli_libspawn').run_child
+    local trace = run_child{'--trace=/dev/stdout'}
+    for _, ph in ipairs{'b', 'e'} do
+        for _, name in ipairs{'sleep', 'join'} do
+            local n = 0
+            local pattern =
+                '"ph":"' .. ph .. '","cat":"async"[^\n]*"name":"' .. name .. '"'
+            for _ in trace:gmatch(pattern) do
+                n = n + 1
+            end
+            print(ph, name, n)
+        end
+    end
+end
@@ -0,0 +1,57 @@
+-- --vm-pool-size hands out pre-initialized VMs that behave just like fresh ones
+local system = require 'system'
+
+if system.environment.EMILUA_TEST_CHILD then
+    local inbox = require 'inbox'
+
+    if _CONTEXT == 'main' then
+        -- more workers than the pool holds so it's refilled in between
+        local reports = {}
+        local last
+        for i = 1, 5 do
+            local w = spawn_vm('.', {
+                memory_limit = 16 * 1024 * 1024,
+                inbox_capacity = 3
+            })
+            -- the worker didn't start yet so only its capacity is used
+            local sent = {}
+            for j = 1, 4 do
+                sent[j] = tostring(w:try_send('filler'))
+            end
+            w:send(inbox)
+            reports[i] = table.concat(sent, ' ') .. ' ' .. inbox:receive()
+            if i < 5 then
+                w:send('bye')
+            else
+                last = w
+            end
+        end
+        for i = 2, 5 do
+            assert(reports[i] == reports[1], reports[i])
+        end
+        print(reports[1])
+        -- taken VMs keep the process (and their core) alive after main is gone
+        last:send('outlive main')
+    else assert(_CONTEXT == 'worker')
+        local stats = system.scheduler_stats()
+        local _, _, limit = system.memory_usage()
+        for _ = 1, 3 do
+            assert(inbox:receive() == 'filler')
+        end
+        local reply = inbox:receive()
+        reply:send(stats.resumes .. ' ' .. limit)
+        if inbox:receive() == 'outlive main' then
+            require('time').sleep(0.1)
+            print('worker done')
+        end
+    end
+else
+    local run_child = require('./cli_libspawn').run_child
+    for _, options in ipairs{
+        {'--vm-pool-size=2'},
+        {'--vm-pool-size=2', '--vm-pool-refill=low-watermark'},
+        {'--vm-pool-size=2', '--cores=2'},
+    } do
+        print((run_child(options):gsub('\n$', '')))
+    end
+end